@@ -0,0 +1,320 @@
+/**
+ * \file    "SerialBench.cpp"
+ *
+ * \brief   Throughput and latency benchmarks for PosixSerial.
+ *
+ * \details Every benchmark runs PosixSerial against the slave end of a fresh pseudo-terminal
+ *          pair, whose master end is served by a child process (the "peer") that either
+ *          produces a stream of messages, swallows everything that it is sent, or echoes it
+ *          back. No serial hardware is needed, and because the peer lives in another process,
+ *          the system calls counted for a benchmark (via /proc/self/io) are our own.
+ *
+ *          The round-trip latency of the port's configuration profiles is measured as well.
+ *          Since a pseudo-terminal has no driver latency to speak of, the difference between the
+ *          profiles only really shows on actual hardware: given a device whose transmit and
+ *          receive lines are looped back (e.g. with a loopback plug), the profiles are measured
+ *          on that device too.
+ *
+ *          Usage: SerialBench [bytes per benchmark] [looped-back device]
+ */
+
+#include "Communication/PosixSerial.h"
+#include "Timer/MonotonicTimer.h"
+using namespace metrobotics;
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+using namespace std;
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
+
+// What the peer on the other end of the loopback does.
+enum PeerMode { PEER_SOURCE, PEER_SINK, PEER_ECHO };
+
+// The buffering modes that the benchmarks compare.
+enum BufferMode { UNBUFFERED, BUFFERED, ASYNC };
+
+static const char *modeName(BufferMode mode)
+{
+	switch (mode) {
+		case UNBUFFERED: return "unbuffered";
+		case BUFFERED:   return "buffered";
+		case ASYNC:      return "async";
+	}
+	return "?";
+}
+
+/**
+ * A pseudo-terminal pair standing in for a serial link, with a peer process on the far end.
+ */
+class Loopback
+{
+	public:
+		Loopback(PeerMode mode, unsigned long msgSize)
+		:mMaster(-1),
+		 mPeer(-1)
+		{
+			if ((mMaster = posix_openpt(O_RDWR | O_NOCTTY)) < 0 ||
+			    grantpt(mMaster) < 0 || unlockpt(mMaster) < 0) {
+				perror("SerialBench: failed to create a pseudo-terminal");
+				exit(1);
+			}
+			mSlaveName = ptsname(mMaster);
+			if ((mPeer = fork()) < 0) {
+				perror("SerialBench: failed to fork the peer");
+				exit(1);
+			} else if (mPeer == 0) {
+				serve(mode, msgSize);
+				_exit(0);
+			}
+		}
+
+		~Loopback()
+		{
+			kill(mPeer, SIGKILL);
+			waitpid(mPeer, 0, 0);
+			close(mMaster);
+		}
+
+		const char *device() const
+		{
+			return mSlaveName.c_str();
+		}
+
+	private:
+		// The peer's main loop.
+		void serve(PeerMode mode, unsigned long msgSize)
+		{
+			vector<char> buf(max(msgSize, 65536UL));
+			if (mode == PEER_SOURCE) {
+				// Messages double as lines: filler followed by a newline.
+				vector<char> msgs(max(msgSize, 4096 / msgSize * msgSize), 'x');
+				for (unsigned long i = msgSize - 1; i < msgs.size(); i += msgSize) {
+					msgs[i] = '\n';
+				}
+				for (;;) {
+					if (write(mMaster, &msgs[0], msgs.size()) < 0 && errno != EINTR) {
+						return;
+					}
+				}
+			}
+			for (;;) {
+				ssize_t n = read(mMaster, &buf[0], buf.size());
+				if (n < 0 && errno != EINTR) {
+					return;
+				}
+				for (ssize_t done = 0, r; mode == PEER_ECHO && done < n; done += r) {
+					if ((r = write(mMaster, &buf[done], n - done)) < 0) {
+						return;
+					}
+				}
+			}
+		}
+
+		int mMaster;
+		pid_t mPeer;
+		string mSlaveName;
+};
+
+// The number of read and write system calls made by this process so far.
+static unsigned long syscalls()
+{
+	ifstream io("/proc/self/io");
+	string key;
+	unsigned long value, total = 0;
+	while (io >> key >> value) {
+		if (key == "syscr:" || key == "syscw:") {
+			total += value;
+		}
+	}
+	return total;
+}
+
+// Open a port with the given configuration and buffering.
+static PosixSerial *openPort(const char *device, const SerialConfig& config, BufferMode mode)
+{
+	PosixSerial *port = new PosixSerial(device, config);
+	port->timeout(2000);
+	if (mode == BUFFERED) {
+		port->inputBuffer(4096);
+		port->outputBuffer(4096);
+	} else if (mode == ASYNC) {
+		port->asyncInput(true);
+	}
+	return port;
+}
+
+// The operations under test.
+enum Operation { GET_BYTE, GET_BLOCK, GET_LINE, PUT_BYTE, PUT_BLOCK };
+
+static const char *operationName(Operation op)
+{
+	switch (op) {
+		case GET_BYTE:  return "getByte";
+		case GET_BLOCK: return "getBlock";
+		case GET_LINE:  return "getLine";
+		case PUT_BYTE:  return "putByte";
+		case PUT_BLOCK: return "putBlock";
+	}
+	return "?";
+}
+
+// Move the given number of messages through the port and report the throughput.
+static void throughput(Operation op, BufferMode mode, unsigned long msgSize, unsigned long nMsgs)
+{
+	bool input = (op == GET_BYTE || op == GET_BLOCK || op == GET_LINE);
+	Loopback link(input ? PEER_SOURCE : PEER_SINK, msgSize);
+	PosixSerial *port = openPort(link.device(), SerialConfig(115200), mode);
+	vector<unsigned char> msg(msgSize, 'x');
+	string line;
+
+	// Remarks: reading /proc/self/io costs reads of its own, which have to be discounted.
+	unsigned long base = syscalls();
+	unsigned long overhead = syscalls() - base;
+	base += overhead;
+	MonotonicTimer t;
+	for (unsigned long i = 0; i < nMsgs; ++i) {
+		switch (op) {
+			case GET_BYTE:
+				for (unsigned long k = 0; k < msgSize; ++k) {
+					msg[k] = port->getByte();
+				}
+				break;
+			case GET_BLOCK:
+				port->getBlock(&msg[0], msgSize);
+				break;
+			case GET_LINE:
+				port->getLine(line);
+				break;
+			case PUT_BYTE:
+				for (unsigned long k = 0; k < msgSize; ++k) {
+					port->putByte(msg[k]);
+				}
+				port->commitOutput();
+				break;
+			case PUT_BLOCK:
+				port->putBlock(&msg[0], msgSize);
+				port->commitOutput();
+				break;
+		}
+	}
+	double seconds = t.elapsedNs() / 1e9;
+	unsigned long calls = syscalls() - base - overhead;
+	delete port;
+
+	cout << left << setw(10) << operationName(op) << setw(12) << modeName(mode)
+	     << right << setw(6) << msgSize << setw(10) << nMsgs
+	     << fixed << setprecision(2) << setw(12) << (msgSize * nMsgs) / seconds / 1e6
+	     << setw(14) << (double)calls / nMsgs << endl;
+}
+
+// Bounce messages off the far end one at a time and report the round-trip latency percentiles.
+static void latency(const char *device, const char *label, const SerialConfig& config,
+                    BufferMode mode, unsigned long msgSize, unsigned long nMsgs)
+{
+	PosixSerial *port = openPort(device, config, mode);
+	vector<unsigned char> msg(msgSize, 'x');
+	vector<double> samples(nMsgs);
+	for (unsigned long i = 0; i < nMsgs; ++i) {
+		MonotonicTimer t;
+		port->putBlock(&msg[0], msgSize);
+		port->commitOutput();
+		port->getBlock(&msg[0], msgSize);
+		samples[i] = t.elapsedNs() / 1e3;
+	}
+	delete port;
+
+	sort(samples.begin(), samples.end());
+	cout << left << setw(10) << "roundtrip" << setw(12) << label
+	     << right << setw(6) << msgSize << setw(10) << nMsgs << fixed << setprecision(1)
+	     << setw(10) << samples[nMsgs / 2]
+	     << setw(10) << samples[nMsgs * 9 / 10]
+	     << setw(10) << samples[nMsgs * 99 / 100]
+	     << setw(10) << samples[nMsgs - 1] << endl;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned long budget = argc > 1 ? strtoul(argv[1], 0, 10) : 256 * 1024;
+	const char *hardware = argc > 2 ? argv[2] : 0;
+	const unsigned long sizes[] = { 1, 16, 64, 256, 1024 };
+	const unsigned long nSizes = sizeof(sizes) / sizeof(sizes[0]);
+	const Operation ops[] = { GET_BYTE, GET_BLOCK, GET_LINE, PUT_BYTE, PUT_BLOCK };
+	const unsigned long nOps = sizeof(ops) / sizeof(ops[0]);
+	const BufferMode modes[] = { UNBUFFERED, BUFFERED, ASYNC };
+	const unsigned long nModes = sizeof(modes) / sizeof(modes[0]);
+
+	try {
+		cout << left << setw(10) << "operation" << setw(12) << "mode" << right << setw(6)
+		     << "size" << setw(10) << "messages" << setw(12) << "MB/s" << setw(14)
+		     << "syscalls/msg" << endl;
+		for (unsigned long o = 0; o < nOps; ++o) {
+			for (unsigned long m = 0; m < nModes; ++m) {
+				// Asynchronous input has no bearing on output.
+				if (modes[m] == ASYNC && (ops[o] == PUT_BYTE || ops[o] == PUT_BLOCK)) {
+					continue;
+				}
+				for (unsigned long s = 0; s < nSizes; ++s) {
+					// A line needs room for its delimiter.
+					if (ops[o] == GET_LINE && sizes[s] < 2) {
+						continue;
+					}
+					throughput(ops[o], modes[m], sizes[s], max(budget / sizes[s], 1UL));
+				}
+			}
+		}
+
+		cout << endl << left << setw(10) << "operation" << setw(12) << "mode" << right
+		     << setw(6) << "size" << setw(10) << "messages" << setw(10) << "p50 us"
+		     << setw(10) << "p90 us" << setw(10) << "p99 us" << setw(10) << "max us" << endl;
+		for (unsigned long m = 0; m < nModes; ++m) {
+			for (unsigned long s = 0; s < nSizes; ++s) {
+				Loopback link(PEER_ECHO, sizes[s]);
+				latency(link.device(), modeName(modes[m]), SerialConfig(115200), modes[m],
+				        sizes[s], 1000);
+			}
+		}
+
+		// Compare the configuration profiles.
+		const char *labels[] = { "plain", "throughput", "latency" };
+		const SerialConfig profiles[] = {
+			SerialConfig(115200), SerialConfig::throughput(115200), SerialConfig::latency(115200)
+		};
+		const unsigned long nProfiles = sizeof(profiles) / sizeof(profiles[0]);
+		for (unsigned long p = 0; p < nProfiles; ++p) {
+			for (unsigned long s = 0; s < nSizes; ++s) {
+				Loopback link(PEER_ECHO, sizes[s]);
+				latency(link.device(), labels[p], profiles[p], UNBUFFERED, sizes[s], 1000);
+			}
+		}
+		if (hardware != 0) {
+			cout << endl << "on " << hardware << ":" << endl;
+			for (unsigned long p = 0; p < nProfiles; ++p) {
+				for (unsigned long s = 0; s < nSizes; ++s) {
+					latency(hardware, labels[p], profiles[p], UNBUFFERED, sizes[s], 1000);
+				}
+			}
+		}
+	} catch (Serial::ReadTimeout&) {
+		cerr << "SerialBench: read timed out" << endl;
+		return 1;
+	} catch (Serial::WriteTimeout&) {
+		cerr << "SerialBench: write timed out" << endl;
+		return 1;
+	} catch (...) {
+		cerr << "SerialBench: benchmark failed" << endl;
+		return 1;
+	}
+	return 0;
+}
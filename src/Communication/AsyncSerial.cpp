@@ -0,0 +1,394 @@
+#include "AsyncSerial.h"
+#include "Timer/MonotonicTimer.h"
+using namespace metrobotics;
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+using namespace std;
+
+#include <sys/epoll.h>
+
+// The amount of input to read from a port at a time.
+static const unsigned long CHUNK_SIZE = 4096;
+
+// The coroutine that runs a spawned task; it gets rid of itself once the task is over.
+struct Executor::Launch
+{
+	struct promise_type
+	{
+		// Remarks: the promise is handed the coroutine's own arguments.
+		promise_type(Executor *executor, Task<void>&)
+		:executor(executor)
+		{
+		}
+
+		Launch get_return_object()
+		{
+			Launch launch;
+			launch.handle = coroutine_handle<promise_type>::from_promise(*this);
+			return launch;
+		}
+
+		suspend_always initial_suspend() noexcept
+		{
+			return suspend_always();
+		}
+
+		struct FinalAwaiter
+		{
+			bool await_ready() noexcept
+			{
+				return false;
+			}
+
+			bool await_suspend(coroutine_handle<promise_type> self) noexcept
+			{
+				self.promise().executor->mTasks.erase(self.address());
+				// Don't suspend after all; the coroutine is destroyed right away.
+				return false;
+			}
+
+			void await_resume() noexcept
+			{
+			}
+		};
+
+		FinalAwaiter final_suspend() noexcept
+		{
+			return FinalAwaiter();
+		}
+
+		void return_void()
+		{
+		}
+
+		void unhandled_exception()
+		{
+			// Remarks: launch() catches everything, so this never happens.
+			terminate();
+		}
+
+		Executor *executor;
+	};
+
+	coroutine_handle<promise_type> handle;
+};
+
+Executor::Launch Executor::launch(Executor *executor, Task<void> task)
+{
+	try {
+		co_await task;
+	} catch (...) {
+		executor->mFailure = current_exception();
+	}
+}
+
+Executor::Executor()
+:mStopped(false)
+{
+}
+
+Executor::~Executor()
+{
+	// Remarks: destroying a task destroys whatever it's waiting for, which in turn stops
+	// waiting (see Sleep and AsyncSerial::Ready).
+	while (!mTasks.empty()) {
+		void *task = *mTasks.begin();
+		mTasks.erase(mTasks.begin());
+		coroutine_handle<>::from_address(task).destroy();
+	}
+}
+
+void Executor::spawn(Task<void>&& task)
+{
+	Launch launch = Executor::launch(this, std::move(task));
+	mTasks.insert(launch.handle.address());
+	mReady.push_back(launch.handle);
+}
+
+void Executor::run()
+{
+	while (!mStopped && !mTasks.empty()) {
+		// Resume whatever is ready; coroutines that are resumed may make others ready.
+		while (!mReady.empty() && !mStopped) {
+			coroutine_handle<> handle = mReady.front();
+			mReady.pop_front();
+			handle.resume();
+			if (mFailure) {
+				exception_ptr failure = mFailure;
+				mFailure = nullptr;
+				rethrow_exception(failure);
+			}
+		}
+		if (mStopped || mTasks.empty()) {
+			break;
+		}
+		// Wait for the devices, but no longer than until the next timeout.
+		int ms = -1;
+		if (!mReady.empty()) {
+			ms = 0;
+		} else if (!mTimers.empty()) {
+			long long left = mTimers.begin()->first - MonotonicTimer::now();
+			ms = left <= 0 ? 0 : (int)min((left + 999999) / 1000000, (long long)INT_MAX);
+		}
+		mReactor.poll(ms);
+		expire();
+	}
+	// Remarks: a stop() that comes before run() still counts.
+	mStopped = false;
+}
+
+void Executor::stop()
+{
+	mStopped = true;
+	mReactor.stop();
+}
+
+Executor::Sleep Executor::sleep(unsigned int ms)
+{
+	return Sleep(*this, ms);
+}
+
+unsigned long Executor::tasks() const
+{
+	return mTasks.size();
+}
+
+Reactor& Executor::reactor()
+{
+	return mReactor;
+}
+
+void Executor::arm(Waiter& waiter, int ms)
+{
+	if (ms >= 0) {
+		waiter.timer = mTimers.insert(make_pair(MonotonicTimer::now() + ms * 1000000LL, &waiter));
+		waiter.timed = true;
+	}
+}
+
+void Executor::disarm(Waiter& waiter)
+{
+	if (waiter.timed) {
+		mTimers.erase(waiter.timer);
+		waiter.timed = false;
+	}
+}
+
+void Executor::wake(Waiter& waiter, IoStatus status)
+{
+	disarm(waiter);
+	if (waiter.port != 0) {
+		waiter.port->forget(waiter);
+	}
+	waiter.status = status;
+	mReady.push_back(waiter.handle);
+}
+
+void Executor::expire()
+{
+	long long t = MonotonicTimer::now();
+	while (!mTimers.empty() && mTimers.begin()->first <= t) {
+		wake(*mTimers.begin()->second, IO_TIMEOUT);
+	}
+}
+
+void AsyncSerial::Ready::await_suspend(coroutine_handle<> caller)
+{
+	mWaiter.handle = caller;
+	mWaiter.port = &mPort;
+	if (mReading) {
+		mPort.mReader = &mWaiter;
+	} else {
+		mPort.mWriter = &mWaiter;
+	}
+	mPort.watch();
+	mPort.mExecutor.arm(mWaiter, mPort.mTimeOut == 0 ? -1 : (int)mPort.mTimeOut);
+}
+
+AsyncSerial::AsyncSerial(Executor& executor, PosixSerial& port)
+:mExecutor(executor),
+ mPort(port),
+ mReader(0),
+ mWriter(0),
+ mEvents(0),
+ mTimeOut(0),
+ mInBuf(CHUNK_SIZE),
+ mInHead(0),
+ mInTail(0)
+{
+}
+
+AsyncSerial::~AsyncSerial()
+{
+	// Remarks: waking the waiters up also takes the port off the reactor (see forget()); were
+	// they left suspended instead, the executor would wait for them forever.
+	if (mReader != 0) {
+		mExecutor.wake(*mReader, IO_CANCELLED);
+	}
+	if (mWriter != 0) {
+		mExecutor.wake(*mWriter, IO_CANCELLED);
+	}
+	if (mEvents != 0) {
+		mExecutor.reactor().remove(mPort.descriptor());
+	}
+}
+
+void AsyncSerial::timeout(unsigned int ms)
+{
+	mTimeOut = ms;
+}
+
+PosixSerial& AsyncSerial::port()
+{
+	return mPort;
+}
+
+AsyncSerial::Ready AsyncSerial::readable()
+{
+	return Ready(*this, true);
+}
+
+AsyncSerial::Ready AsyncSerial::writable()
+{
+	return Ready(*this, false);
+}
+
+void AsyncSerial::ready(int, unsigned int events)
+{
+	// Remarks: a device that has hung up (or failed) is ready for nothing anymore, but wakes
+	// up its waiters so that they can find out.
+	IoStatus status = (events & (EPOLLHUP | EPOLLERR)) ? IO_FAILURE : IO_OK;
+	if (mReader != 0 && (events & (EPOLLIN | EPOLLHUP | EPOLLERR))) {
+		mExecutor.wake(*mReader, status);
+	}
+	if (mWriter != 0 && (events & (EPOLLOUT | EPOLLHUP | EPOLLERR))) {
+		mExecutor.wake(*mWriter, status);
+	}
+}
+
+void AsyncSerial::watch()
+{
+	// Remarks: the reactor waits for level-triggered events, so a port must only be
+	// registered while somebody is actually waiting for it.
+	unsigned int events = (mReader != 0 ? EPOLLIN : 0) | (mWriter != 0 ? EPOLLOUT : 0);
+	if (events != mEvents) {
+		if (events == 0) {
+			mExecutor.reactor().remove(mPort.descriptor());
+		} else {
+			mExecutor.reactor().add(mPort.descriptor(), *this, events);
+		}
+		mEvents = events;
+	}
+}
+
+void AsyncSerial::forget(Executor::Waiter& waiter)
+{
+	if (waiter.port == 0) {
+		return;
+	}
+	waiter.port = 0;
+	mExecutor.disarm(waiter);
+	if (mReader == &waiter) {
+		mReader = 0;
+	}
+	if (mWriter == &waiter) {
+		mWriter = 0;
+	}
+	watch();
+}
+
+Task<IoStatus> AsyncSerial::fill()
+{
+	bool hungUp = false;
+	for (;;) {
+		IoResult r = mPort.readSome(&mInBuf[0], mInBuf.size(), 0);
+		if (r.nBytes > 0) {
+			mInHead = 0;
+			mInTail = r.nBytes;
+			co_return IO_OK;
+		}
+		// Remarks: after a hang-up, whatever input is left has just been read.
+		if (r.status == IO_FAILURE || hungUp) {
+			co_return IO_FAILURE;
+		}
+		IoStatus status = co_await readable();
+		// Remarks: once cancelled, the port (and with it this object) may be gone.
+		if (status == IO_TIMEOUT || status == IO_CANCELLED) {
+			co_return status;
+		}
+		hungUp = status == IO_FAILURE;
+	}
+}
+
+Task<IoResult> AsyncSerial::readAsync(unsigned char *buf, unsigned long nBytes)
+{
+	if (buf == 0) {
+		throw Serial::NullPointer();
+	}
+	IoResult r;
+	r.nBytes = 0;
+	r.status = IO_OK;
+	while (r.nBytes < nBytes) {
+		if (mInHead == mInTail && (r.status = co_await fill()) != IO_OK) {
+			break;
+		}
+		unsigned long n = min(nBytes - r.nBytes, mInTail - mInHead);
+		memcpy(buf + r.nBytes, &mInBuf[mInHead], n);
+		mInHead += n;
+		r.nBytes += n;
+	}
+	co_return r;
+}
+
+Task<IoResult> AsyncSerial::readLineAsync(unsigned char *buf, unsigned long nBytes,
+                                          unsigned char delimiter)
+{
+	if (buf == 0) {
+		throw Serial::NullPointer();
+	}
+	IoResult r;
+	r.nBytes = 0;
+	r.status = IO_OK;
+	while (r.nBytes < nBytes) {
+		if (mInHead == mInTail && (r.status = co_await fill()) != IO_OK) {
+			break;
+		}
+		const unsigned char *src = &mInBuf[mInHead];
+		unsigned long n = min(nBytes - r.nBytes, mInTail - mInHead);
+		const void *hit = memchr(src, delimiter, n);
+		if (hit != 0) {
+			n = (const unsigned char *)hit - src + 1;
+		}
+		memcpy(buf + r.nBytes, src, n);
+		mInHead += n;
+		r.nBytes += n;
+		if (hit != 0) {
+			break;
+		}
+	}
+	co_return r;
+}
+
+Task<IoResult> AsyncSerial::writeAsync(const unsigned char *buf, unsigned long nBytes)
+{
+	if (buf == 0) {
+		throw Serial::NullPointer();
+	}
+	IoResult r;
+	r.nBytes = 0;
+	r.status = IO_OK;
+	while (r.nBytes < nBytes) {
+		IoResult w = mPort.writeSome(buf + r.nBytes, nBytes - r.nBytes, 0);
+		r.nBytes += w.nBytes;
+		if (w.status == IO_FAILURE) {
+			r.status = IO_FAILURE;
+			break;
+		}
+		if (w.nBytes == 0 && (r.status = co_await writable()) != IO_OK) {
+			break;
+		}
+	}
+	co_return r;
+}
@@ -0,0 +1,533 @@
+#ifndef METROBOTICS_ASYNCSERIAL_H
+#define METROBOTICS_ASYNCSERIAL_H
+
+// Remarks: coroutines need C++20 (e.g. g++ -std=c++20); without them, this header is empty.
+#if defined(__cpp_impl_coroutine)
+
+#include "PosixSerial.h"
+#include "Reactor.h"
+#include <atomic>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <map>
+#include <optional>
+#include <set>
+#include <utility>
+#include <vector>
+
+namespace metrobotics
+{
+	class Executor;
+	class AsyncSerial;
+
+	//! @cond INTERNAL
+	// The part of a task's promise that doesn't depend on the task's result.
+	class TaskPromise
+	{
+		public:
+			// Tasks start only once they're awaited.
+			std::suspend_always initial_suspend() noexcept
+			{
+				return std::suspend_always();
+			}
+
+			// A finished task resumes whoever awaited it.
+			struct FinalAwaiter
+			{
+				bool await_ready() noexcept
+				{
+					return false;
+				}
+
+				template <class P>
+				std::coroutine_handle<> await_suspend(std::coroutine_handle<P> self) noexcept
+				{
+					std::coroutine_handle<> next = self.promise().mContinuation;
+					return next ? next : std::noop_coroutine();
+				}
+
+				void await_resume() noexcept
+				{
+				}
+			};
+
+			FinalAwaiter final_suspend() noexcept
+			{
+				return FinalAwaiter();
+			}
+
+			void unhandled_exception()
+			{
+				mException = std::current_exception();
+			}
+
+			std::coroutine_handle<> mContinuation;
+			std::exception_ptr mException;
+	};
+	//! @endcond
+
+	/**
+	 * \class   Task
+	 *
+	 * \brief   A coroutine that produces a value of type T.
+	 *
+	 * \details A task doesn't start until it's awaited (with \c co_await) by another coroutine,
+	 *          which then resumes once the task has finished; whatever the task throws is thrown
+	 *          at the \c co_await. Tasks that nobody awaits are run by Executor::spawn().
+	 */
+	template <class T>
+	class Task
+	{
+		public:
+			struct promise_type : public TaskPromise
+			{
+				Task get_return_object()
+				{
+					return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+				}
+
+				template <class U>
+				void return_value(U&& value)
+				{
+					mValue.emplace(std::forward<U>(value));
+				}
+
+				std::optional<T> mValue;
+			};
+
+			Task(Task&& task) noexcept
+			:mHandle(task.mHandle)
+			{
+				task.mHandle = nullptr;
+			}
+
+			~Task()
+			{
+				if (mHandle) {
+					mHandle.destroy();
+				}
+			}
+
+			// [Awaiting.]
+			bool await_ready() const noexcept
+			{
+				return false;
+			}
+
+			std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) noexcept
+			{
+				mHandle.promise().mContinuation = caller;
+				return mHandle;
+			}
+
+			T await_resume()
+			{
+				if (mHandle.promise().mException) {
+					std::rethrow_exception(mHandle.promise().mException);
+				}
+				return std::move(*mHandle.promise().mValue);
+			}
+
+		private:
+			// Disable copying and assignment for Task objects.
+			Task(const Task&);
+			Task& operator=(const Task&);
+
+			explicit Task(std::coroutine_handle<promise_type> handle)
+			:mHandle(handle)
+			{
+			}
+
+			// Internal state members.
+			std::coroutine_handle<promise_type> mHandle;
+	};
+
+	template <>
+	class Task<void>
+	{
+		public:
+			struct promise_type : public TaskPromise
+			{
+				Task get_return_object()
+				{
+					return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+				}
+
+				void return_void()
+				{
+				}
+			};
+
+			Task(Task&& task) noexcept
+			:mHandle(task.mHandle)
+			{
+				task.mHandle = nullptr;
+			}
+
+			~Task()
+			{
+				if (mHandle) {
+					mHandle.destroy();
+				}
+			}
+
+			// [Awaiting.]
+			bool await_ready() const noexcept
+			{
+				return false;
+			}
+
+			std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) noexcept
+			{
+				mHandle.promise().mContinuation = caller;
+				return mHandle;
+			}
+
+			void await_resume()
+			{
+				if (mHandle.promise().mException) {
+					std::rethrow_exception(mHandle.promise().mException);
+				}
+			}
+
+		private:
+			// Disable copying and assignment for Task objects.
+			Task(const Task&);
+			Task& operator=(const Task&);
+
+			explicit Task(std::coroutine_handle<promise_type> handle)
+			:mHandle(handle)
+			{
+			}
+
+			// Internal state members.
+			std::coroutine_handle<promise_type> mHandle;
+	};
+
+	/**
+	 * \class   Executor
+	 *
+	 * \brief   Runs any number of coroutines on a single thread.
+	 *
+	 * \details Coroutines that wait for a device (see AsyncSerial) or for time to pass (see
+	 *          sleep()) are suspended, and the executor waits for all of them at once with a
+	 *          Reactor; when a device becomes ready, or a wait runs out of time, the coroutine
+	 *          that waits for it is resumed. That way, hundreds of conversations with devices
+	 *          can run on one thread, each written as plain sequential code:
+	 *          \code
+	 *              Task<void> talk(AsyncSerial& port)
+	 *              {
+	 *                  unsigned char line[80];
+	 *                  co_await port.writeAsync((const unsigned char *)"PING\n", 5);
+	 *                  IoResult r = co_await port.readLineAsync(line, sizeof(line));
+	 *                  // ...
+	 *              }
+	 *
+	 *              Executor executor;
+	 *              executor.spawn(talk(port));
+	 *              executor.run();
+	 *          \endcode
+	 *
+	 * \warning Everything but stop() must be called from the thread that runs the executor.
+	 */
+	class Executor
+	{
+		public:
+			/**
+			 * \brief   Suspends a coroutine for some time (see sleep()).
+			 */
+			class Sleep;
+
+			/**
+			 * \brief   Construct an executor with no tasks.
+			 *
+			 * \exception Reactor::ReactorFailure is thrown when the reactor can't be created
+			 */
+			Executor();
+
+			/**
+			 * \brief   Destroy the executor, along with any tasks that haven't finished.
+			 */
+			~Executor();
+
+			/**
+			 * \brief   Hand a task over to the executor; it starts running in run().
+			 */
+			void spawn(Task<void>&& task);
+
+			/**
+			 * \brief   Run the tasks until all of them have finished, or until stop() is called.
+			 *
+			 * \details An exception that escapes a task ends that task, and is then thrown from
+			 *          here (after which run() may simply be called again).
+			 */
+			void run();
+
+			/**
+			 * \brief   Make run() return as soon as possible.
+			 *
+			 * \details Safe to call from any thread, including from within a task.
+			 */
+			void stop();
+
+			/**
+			 * \brief   Suspend the calling coroutine for the given time: <tt>co_await
+			 *          executor.sleep(ms)</tt>.
+			 */
+			Sleep sleep(unsigned int ms);
+
+			/**
+			 * \brief   The number of tasks that haven't finished yet.
+			 */
+			unsigned long tasks() const;
+
+			/**
+			 * \brief   The reactor that the executor waits with.
+			 *
+			 * \details Other descriptors may be registered with it, too; their handlers are
+			 *          called from within run().
+			 */
+			Reactor& reactor();
+
+		private:
+			// Disable copying and assignment for Executor objects.
+			Executor(const Executor&);
+			Executor& operator=(const Executor&);
+
+			friend class AsyncSerial;
+
+			// A suspended coroutine that waits for a device or for time to pass.
+			struct Waiter
+			{
+				std::coroutine_handle<> handle;
+				IoStatus status;
+				bool timed; // whether timer is valid
+				std::multimap<long long, Waiter *>::iterator timer;
+				AsyncSerial *port; // if waiting for a device
+			};
+
+			// The coroutine that runs a spawned task.
+			struct Launch;
+
+			// Run a spawned task to its end.
+			static Launch launch(Executor *executor, Task<void> task);
+
+			// Start timing a waiter out after ms milliseconds (never, if ms is negative), and
+			// stop doing so.
+			void arm(Waiter& waiter, int ms);
+			void disarm(Waiter& waiter);
+
+			// Stop a waiter from waiting, and have its coroutine resumed.
+			void wake(Waiter& waiter, IoStatus status);
+
+			// Wake up the waiters whose time has run out.
+			void expire();
+
+			// Internal state members.
+			Reactor mReactor;
+			std::atomic<bool> mStopped;
+			std::deque<std::coroutine_handle<> > mReady; // to be resumed
+			std::multimap<long long, Waiter *> mTimers;  // by deadline, in nanoseconds
+			std::set<void *> mTasks;                     // spawned tasks (their coroutines)
+			std::exception_ptr mFailure;                 // escaped from a task
+	};
+
+	class Executor::Sleep
+	{
+		public:
+			bool await_ready() const noexcept
+			{
+				return false;
+			}
+
+			void await_suspend(std::coroutine_handle<> caller)
+			{
+				mWaiter.handle = caller;
+				mExecutor.arm(mWaiter, mTime);
+			}
+
+			void await_resume() noexcept
+			{
+			}
+
+			~Sleep()
+			{
+				// Remarks: the coroutine may be destroyed while it's asleep.
+				mExecutor.disarm(mWaiter);
+			}
+
+		private:
+			friend class Executor;
+
+			Sleep(Executor& executor, unsigned int ms)
+			:mExecutor(executor),
+			 mTime(ms)
+			{
+				mWaiter.status = IO_OK;
+				mWaiter.timed = false;
+				mWaiter.port = 0;
+			}
+
+			// Internal state members.
+			Executor& mExecutor;
+			int mTime;
+			Waiter mWaiter;
+	};
+
+	/**
+	 * \class   AsyncSerial
+	 *
+	 * \brief   Awaitable I/O on a PosixSerial port, for coroutines run by an Executor.
+	 *
+	 * \details Each operation is a Task that transfers as much as it can without blocking, and
+	 *          suspends the coroutine that awaits it whenever the port isn't ready; the thread
+	 *          meanwhile goes on running other coroutines. Instead of throwing, operations report
+	 *          how much they've transferred and how they ended, just like DataSource::readSome()
+	 *          and DataSink::writeSome(). Input is read in chunks into a buffer of the port's
+	 *          own, from which lines and blocks are then served.
+	 *
+	 * \warning The port must not use asynchronous input (see PosixSerial::asyncInput()). Only one
+	 *          coroutine at a time may read from the port, and only one may write to it, and
+	 *          nothing else may read from it while it's being used by an AsyncSerial. As with
+	 *          writeSome(), output that is held back by the port's output buffer counts as
+	 *          written; it's up to the caller to commit it.
+	 */
+	class AsyncSerial : private Reactor::Handler
+	{
+		public:
+			/**
+			 * \brief   Suspends a coroutine until the port is ready.
+			 */
+			class Ready;
+
+			/**
+			 * \brief   Use a port with the given executor; both must outlive this object.
+			 */
+			AsyncSerial(Executor& executor, PosixSerial& port);
+
+			/**
+			 * \brief   Destructor; coroutines that are still waiting for the port are resumed
+			 *          (by the executor) with IO_CANCELLED, so that they can finish.
+			 */
+			~AsyncSerial();
+
+			/**
+			 * \brief   Set a timeout (in milliseconds) for each wait for the port.
+			 * \details A timeout of 0 (the default) may wait indefinitely.
+			 */
+			void timeout(unsigned int ms = 0);
+
+			/**
+			 * \brief   The port.
+			 */
+			PosixSerial& port();
+
+			/**
+			 * \brief   Read exactly \c nBytes bytes (unless the port times out or fails first).
+			 */
+			Task<IoResult> readAsync(unsigned char *buf, unsigned long nBytes);
+
+			/**
+			 * \brief   Read up to and including the delimiter, but never more than \c nBytes.
+			 *
+			 * \details Ends successfully when either the delimiter has been read or \c buf is
+			 *          full; what comes after the delimiter stays buffered for the next read.
+			 */
+			Task<IoResult> readLineAsync(unsigned char *buf, unsigned long nBytes,
+			                             unsigned char delimiter = '\n');
+
+			/**
+			 * \brief   Write all \c nBytes bytes (unless the port times out or fails first).
+			 */
+			Task<IoResult> writeAsync(const unsigned char *buf, unsigned long nBytes);
+
+			/**
+			 * \brief   Wait until there's input, or until the port can take output: <tt>co_await
+			 *          port.readable()</tt>.
+			 *
+			 * \returns (from the \c co_await) IO_OK once the port is ready, IO_TIMEOUT when the
+			 *          timeout runs out first, IO_FAILURE when the device has hung up, and
+			 *          IO_CANCELLED when this object has been destroyed in the meantime (in which
+			 *          case it mustn't be touched anymore)
+			 */
+			Ready readable();
+			Ready writable();
+
+		private:
+			// Disable copying and assignment for AsyncSerial objects.
+			AsyncSerial(const AsyncSerial&);
+			AsyncSerial& operator=(const AsyncSerial&);
+
+			friend class Executor;
+
+			// Implement the reactor's handler.
+			void ready(int fd, unsigned int events);
+
+			// Bring the port's registration with the reactor up to date with its waiters.
+			void watch();
+
+			// Stop waiting (without resuming the waiter).
+			void forget(Executor::Waiter& waiter);
+
+			// Make sure that the input buffer isn't empty, waiting if need be.
+			Task<IoStatus> fill();
+
+			// Internal state members.
+			Executor& mExecutor;
+			PosixSerial& mPort;
+			Executor::Waiter *mReader;
+			Executor::Waiter *mWriter;
+			unsigned int mEvents; // registered with the reactor
+			unsigned int mTimeOut; // in milliseconds
+			std::vector<unsigned char> mInBuf;
+			unsigned long mInHead; // unread input is at [mInHead, mInTail)
+			unsigned long mInTail;
+	};
+
+	class AsyncSerial::Ready
+	{
+		public:
+			bool await_ready() const noexcept
+			{
+				return false;
+			}
+
+			void await_suspend(std::coroutine_handle<> caller);
+
+			IoStatus await_resume() noexcept
+			{
+				return mWaiter.status;
+			}
+
+			~Ready()
+			{
+				// Remarks: the coroutine may be destroyed while it's waiting (and even after the
+				// port is gone, see ~AsyncSerial()).
+				if (mWaiter.port != 0) {
+					mWaiter.port->forget(mWaiter);
+				}
+			}
+
+		private:
+			friend class AsyncSerial;
+
+			Ready(AsyncSerial& port, bool reading)
+			:mPort(port),
+			 mReading(reading)
+			{
+				mWaiter.status = IO_OK;
+				mWaiter.timed = false;
+				mWaiter.port = 0;
+			}
+
+			// Internal state members.
+			AsyncSerial& mPort;
+			bool mReading;
+			Executor::Waiter mWaiter;
+	};
+}
+
+#endif
+
+#endif
@@ -0,0 +1,125 @@
+#include "ByteRing.h"
+using namespace metrobotics;
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+using namespace std;
+
+ByteRing::ByteRing(unsigned long nBytes)
+:mData(0),
+ mMask(roundUp(nBytes) - 1),
+ mHead(0),
+ mTail(0)
+{
+	mData = new unsigned char[capacity()];
+}
+
+ByteRing::ByteRing(unsigned long nBytes, bool)
+:mData(0),
+ mMask(roundUp(nBytes) - 1),
+ mHead(0),
+ mTail(0)
+{
+}
+
+ByteRing *ByteRing::place(void *memory, unsigned long nBytes)
+{
+	return new (memory) ByteRing(nBytes, true);
+}
+
+unsigned long ByteRing::footprint(unsigned long nBytes)
+{
+	return sizeof(ByteRing) + roundUp(nBytes);
+}
+
+ByteRing::~ByteRing()
+{
+	delete [] mData;
+}
+
+unsigned long ByteRing::roundUp(unsigned long nBytes)
+{
+	unsigned long capacity = 1;
+	while (capacity < nBytes) {
+		capacity <<= 1;
+	}
+	return capacity;
+}
+
+unsigned char *ByteRing::data() const
+{
+	// Remarks: a placed ring's storage starts right where the ring ends.
+	return mData != 0 ? mData : (unsigned char *)(this + 1);
+}
+
+unsigned long ByteRing::capacity() const
+{
+	return mMask + 1;
+}
+
+unsigned long ByteRing::writable() const
+{
+	return capacity() - (mTail.load(memory_order_relaxed) - mHead.load(memory_order_acquire));
+}
+
+unsigned long ByteRing::write(const unsigned char *buf, unsigned long nBytes)
+{
+	unsigned long total = 0;
+	unsigned char *space;
+	unsigned long n;
+	// Remarks: the free space may wrap around the end of the ring, hence (at most) two pieces.
+	while (total < nBytes && (n = writeSpace(&space)) > 0) {
+		n = min(n, nBytes - total);
+		memcpy(space, buf + total, n);
+		commitWrite(n);
+		total += n;
+	}
+	return total;
+}
+
+unsigned long ByteRing::writeSpace(unsigned char **buf)
+{
+	unsigned long tail = mTail.load(memory_order_relaxed);
+	unsigned long offset = tail & mMask;
+	*buf = data() + offset;
+	return min(writable(), capacity() - offset);
+}
+
+void ByteRing::commitWrite(unsigned long nBytes)
+{
+	mTail.store(mTail.load(memory_order_relaxed) + nBytes, memory_order_release);
+}
+
+unsigned long ByteRing::readable() const
+{
+	return mTail.load(memory_order_acquire) - mHead.load(memory_order_relaxed);
+}
+
+unsigned long ByteRing::read(unsigned char *buf, unsigned long nBytes)
+{
+	unsigned long total = 0;
+	const unsigned char *data;
+	unsigned long n;
+	// Remarks: the data may wrap around the end of the ring, hence (at most) two pieces.
+	while (total < nBytes && (n = readSpace(&data)) > 0) {
+		n = min(n, nBytes - total);
+		memcpy(buf + total, data, n);
+		commitRead(n);
+		total += n;
+	}
+	return total;
+}
+
+unsigned long ByteRing::readSpace(const unsigned char **buf) const
+{
+	unsigned long head = mHead.load(memory_order_relaxed);
+	unsigned long offset = head & mMask;
+	*buf = data() + offset;
+	return min(readable(), capacity() - offset);
+}
+
+void ByteRing::commitRead(unsigned long nBytes)
+{
+	mHead.store(mHead.load(memory_order_relaxed) + nBytes, memory_order_release);
+}
@@ -0,0 +1,149 @@
+#ifndef METROBOTICS_BYTERING_H
+#define METROBOTICS_BYTERING_H
+
+#include <atomic>
+
+namespace metrobotics
+{
+	/**
+	 * \class   ByteRing
+	 *
+	 * \brief   A lock-free ring buffer of bytes for exactly one producer and one consumer.
+	 *
+	 * \details The producer and the consumer may live on different threads and never have to
+	 *          take a lock: the producer only ever advances the tail of the ring and the consumer
+	 *          only ever advances its head. Besides copying bytes in and out of the ring, both
+	 *          sides can work on the ring's memory directly (see writeSpace() and readSpace()),
+	 *          which lets the producer read() straight into the ring and the consumer scan it
+	 *          in place.
+	 *
+	 * \warning The producer side (writable(), write(), writeSpace(), commitWrite()) and the
+	 *          consumer side (readable(), read(), readSpace(), commitRead()) must each be used by
+	 *          no more than one thread at a time.
+	 */
+	class ByteRing
+	{
+		public:
+			/**
+			 * \brief   Construct an empty ring.
+			 *
+			 * \arg     nBytes is the minimum capacity of the ring; it is rounded up to the next
+			 *          power of two
+			 */
+			explicit ByteRing(unsigned long nBytes);
+
+			/**
+			 * \brief   Construct an empty ring in the given memory, with its storage right
+			 *          behind it.
+			 *
+			 * \details Such a ring refers to its storage relative to its own address, and its
+			 *          indices are lock-free atomics, so it works from any process that maps
+			 *          the memory (wherever it is mapped); other processes simply use the ring
+			 *          at that memory without constructing it again. The memory must be aligned
+			 *          to (at least) a cache line and hold footprint(nBytes) bytes. Destroying
+			 *          the ring is optional, as it doesn't own any other resources.
+			 *
+			 * \arg     memory is where the ring is placed
+			 * \arg     nBytes is the minimum capacity of the ring (see above)
+			 */
+			static ByteRing *place(void *memory, unsigned long nBytes);
+
+			/**
+			 * \brief   The number of bytes that place() needs for a ring of the given capacity.
+			 */
+			static unsigned long footprint(unsigned long nBytes);
+
+			/**
+			 * \brief   Destructor.
+			 */
+			~ByteRing();
+
+			/**
+			 * \brief   The number of bytes that the ring can hold.
+			 */
+			unsigned long capacity() const;
+
+			// [Producer side.]
+			/**
+			 * \brief   The number of bytes that can be written without overflowing the ring.
+			 */
+			unsigned long writable() const;
+
+			/**
+			 * \brief   Copy as many bytes as will fit into the ring.
+			 *
+			 * \returns the number of bytes that were copied
+			 */
+			unsigned long write(const unsigned char *buf, unsigned long nBytes);
+
+			/**
+			 * \brief   Find the contiguous free space at the tail of the ring.
+			 *
+			 * \details Bytes stored into this space become visible to the consumer only once
+			 *          they are committed by commitWrite().
+			 *
+			 * \returns the number of bytes available at \c *buf
+			 */
+			unsigned long writeSpace(unsigned char **buf);
+
+			/**
+			 * \brief   Hand the given number of bytes at the tail of the ring to the consumer.
+			 */
+			void commitWrite(unsigned long nBytes);
+
+			// [Consumer side.]
+			/**
+			 * \brief   The number of bytes that can be read from the ring.
+			 */
+			unsigned long readable() const;
+
+			/**
+			 * \brief   Copy as many bytes as are available out of the ring.
+			 *
+			 * \returns the number of bytes that were copied
+			 */
+			unsigned long read(unsigned char *buf, unsigned long nBytes);
+
+			/**
+			 * \brief   Find the contiguous run of bytes at the head of the ring.
+			 *
+			 * \details The bytes remain in the ring until they are released by commitRead().
+			 *
+			 * \returns the number of bytes available at \c *buf
+			 */
+			unsigned long readSpace(const unsigned char **buf) const;
+
+			/**
+			 * \brief   Release the given number of bytes at the head of the ring.
+			 */
+			void commitRead(unsigned long nBytes);
+
+		private:
+			// Disable copying and assignment for ByteRing objects.
+			ByteRing(const ByteRing&);
+			ByteRing& operator=(const ByteRing&);
+
+			// Construct a ring whose storage is right behind it (see place()).
+			ByteRing(unsigned long nBytes, bool);
+
+			// Round a capacity up to a power of two, so that indexing is a simple mask.
+			static unsigned long roundUp(unsigned long nBytes);
+
+			// The ring's storage.
+			unsigned char *data() const;
+
+			// Keep the producer's and the consumer's state on separate cache lines.
+			enum { CACHE_LINE = 64 };
+
+			// Internal state members.
+			unsigned char *mData; // null when the storage is right behind the ring
+			unsigned long mMask;  // capacity - 1
+
+			// Remarks: head and tail count bytes from the very beginning and are reduced modulo
+			// the capacity only when indexing; the ring is empty when they're equal.
+			alignas(CACHE_LINE) std::atomic<unsigned long> mHead; // advanced by the consumer
+			alignas(CACHE_LINE) std::atomic<unsigned long> mTail; // advanced by the producer
+	};
+}
+
+#endif
@@ -0,0 +1,174 @@
+#include "OutputScheduler.h"
+using namespace metrobotics;
+
+#include <cerrno>
+#include <ctime>
+using namespace std;
+
+OutputScheduler::OutputScheduler(DataSink& sink, const unsigned long *bounds,
+                                 unsigned int nClasses)
+:mSink(sink),
+ mClasses(nClasses),
+ mPending(0),
+ mStopping(false),
+ mFailed(false)
+{
+	if (bounds == 0) {
+		throw Serial::NullPointer();
+	}
+	for (unsigned int i = 0; i < nClasses; ++i) {
+		mClasses[i].queued = 0;
+		mClasses[i].bound = bounds[i];
+	}
+	pthread_mutex_init(&mLock, 0);
+	pthread_cond_init(&mWork, 0);
+	// Remarks: timed waits for room are measured on the monotonic clock.
+	pthread_condattr_t attr;
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&mSpace, &attr);
+	pthread_condattr_destroy(&attr);
+	if (pthread_create(&mThread, 0, run, this) != 0) {
+		pthread_cond_destroy(&mSpace);
+		pthread_cond_destroy(&mWork);
+		pthread_mutex_destroy(&mLock);
+		throw ThreadFailure();
+	}
+}
+
+OutputScheduler::~OutputScheduler()
+{
+	flush();
+	pthread_mutex_lock(&mLock);
+	mStopping = true;
+	pthread_cond_signal(&mWork);
+	pthread_mutex_unlock(&mLock);
+	pthread_join(mThread, 0);
+	pthread_cond_destroy(&mSpace);
+	pthread_cond_destroy(&mWork);
+	pthread_mutex_destroy(&mLock);
+}
+
+IoStatus OutputScheduler::post(unsigned int priority, const unsigned char *msg,
+                               unsigned long nBytes, int ms)
+{
+	if (msg == 0) {
+		throw Serial::NullPointer();
+	} else if (priority >= mClasses.size()) {
+		throw InvalidClass();
+	}
+	Class& c = mClasses[priority];
+	if (nBytes > c.bound) {
+		throw MessageTooLarge();
+	}
+
+	struct timespec deadline;
+	if (ms > 0) {
+		clock_gettime(CLOCK_MONOTONIC, &deadline);
+		deadline.tv_sec += ms / 1000;
+		deadline.tv_nsec += (ms % 1000) * 1000000L;
+		if (deadline.tv_nsec >= 1000000000L) {
+			deadline.tv_sec += 1;
+			deadline.tv_nsec -= 1000000000L;
+		}
+	}
+	pthread_mutex_lock(&mLock);
+	while (!mFailed && c.queued + nBytes > c.bound) {
+		if (ms == 0 || (ms > 0 && pthread_cond_timedwait(&mSpace, &mLock, &deadline) == ETIMEDOUT)) {
+			pthread_mutex_unlock(&mLock);
+			return IO_TIMEOUT;
+		} else if (ms < 0) {
+			pthread_cond_wait(&mSpace, &mLock);
+		}
+	}
+	if (mFailed) {
+		pthread_mutex_unlock(&mLock);
+		return IO_FAILURE;
+	}
+	c.messages.push_back(vector<unsigned char>(msg, msg + nBytes));
+	c.queued += nBytes;
+	if (mPending++ == 0) {
+		pthread_cond_signal(&mWork);
+	}
+	pthread_mutex_unlock(&mLock);
+	return IO_OK;
+}
+
+void OutputScheduler::flush()
+{
+	pthread_mutex_lock(&mLock);
+	while (mPending > 0 && !mFailed) {
+		pthread_cond_wait(&mSpace, &mLock);
+	}
+	pthread_mutex_unlock(&mLock);
+}
+
+unsigned long OutputScheduler::queued(unsigned int priority) const
+{
+	if (priority >= mClasses.size()) {
+		throw InvalidClass();
+	}
+	pthread_mutex_lock(&mLock);
+	unsigned long n = mClasses[priority].queued;
+	pthread_mutex_unlock(&mLock);
+	return n;
+}
+
+bool OutputScheduler::failed() const
+{
+	pthread_mutex_lock(&mLock);
+	bool f = mFailed;
+	pthread_mutex_unlock(&mLock);
+	return f;
+}
+
+void *OutputScheduler::run(void *arg)
+{
+	OutputScheduler *self = static_cast<OutputScheduler *>(arg);
+	pthread_mutex_lock(&self->mLock);
+	for (;;) {
+		while (self->mPending == 0 && !self->mStopping) {
+			pthread_cond_wait(&self->mWork, &self->mLock);
+		}
+		if (self->mPending == 0) {
+			break;
+		}
+		// Take the oldest message of the most urgent class that has any.
+		unsigned int i = 0;
+		while (self->mClasses[i].messages.empty()) {
+			++i;
+		}
+		Class& c = self->mClasses[i];
+		vector<unsigned char> msg;
+		msg.swap(c.messages.front());
+		c.messages.pop_front();
+		pthread_mutex_unlock(&self->mLock);
+
+		bool ok = true;
+		try {
+			if (!msg.empty()) {
+				self->mSink.putBlock(&msg[0], msg.size());
+			}
+			self->mSink.commitOutput();
+		} catch (...) {
+			ok = false;
+		}
+
+		// Remarks: the message's bytes count against its class until it's out, which keeps
+		// the latency bound honest.
+		pthread_mutex_lock(&self->mLock);
+		c.queued -= msg.size();
+		--self->mPending;
+		if (!ok) {
+			self->mFailed = true;
+			for (unsigned int k = 0; k < self->mClasses.size(); ++k) {
+				self->mClasses[k].messages.clear();
+				self->mClasses[k].queued = 0;
+			}
+			self->mPending = 0;
+		}
+		pthread_cond_broadcast(&self->mSpace);
+	}
+	pthread_mutex_unlock(&self->mLock);
+	return 0;
+}
@@ -0,0 +1,126 @@
+#ifndef METROBOTICS_OUTPUTSCHEDULER_H
+#define METROBOTICS_OUTPUTSCHEDULER_H
+
+#include "Serial.h"
+#include <deque>
+#include <vector>
+#include <pthread.h>
+
+namespace metrobotics
+{
+	/**
+	 * \class   OutputScheduler
+	 *
+	 * \brief   Sends messages of different priorities through a sink, most urgent first.
+	 *
+	 * \details Messages are posted to one of several priority classes (class 0 being the most
+	 *          urgent one), and a dedicated writer thread hands them to the sink one whole
+	 *          message at a time: always the oldest message of the most urgent class that has
+	 *          any. A message is never interrupted once it's being written, but as soon as it's
+	 *          out, an urgent message that was posted in the meantime goes ahead of whatever
+	 *          bulk traffic is still queued.
+	 *
+	 *          Each class holds a bounded number of bytes (counting the message that's being
+	 *          written); posting to a class that is full waits until there's room, and messages
+	 *          that are larger than their class's bound are refused outright. With bounds b[i],
+	 *          a message of class 0 therefore goes out after at most b[0] bytes of class 0 (its
+	 *          own included), plus the largest message of a less urgent class, have been
+	 *          written; in other words, its worst-case latency is bounded by the bounds alone, no matter how much
+	 *          other traffic is offered. Mind that output that the sink itself holds back (e.g.
+	 *          in the device driver) adds to that.
+	 *
+	 *          No such bound holds for the less urgent classes: a message of class p > 0 waits
+	 *          for as long as any more urgent class has messages, so traffic that keeps one of
+	 *          them busy starves class p for as long as it lasts.
+	 *
+	 *          Messages may be posted from any number of threads. The scheduler must be the
+	 *          only one that writes to the sink for as long as it exists.
+	 */
+	class OutputScheduler
+	{
+		public:
+			// [Exceptions.]
+			class ThreadFailure {};
+			class InvalidClass {};
+			class MessageTooLarge {};
+
+			/**
+			 * \brief   Construct a scheduler in front of the given sink.
+			 *
+			 * \arg     bounds holds the maximum number of bytes that may be queued in each of
+			 *          the \c nClasses priority classes
+			 *
+			 * \exception ThreadFailure is thrown when the writer thread can't be started
+			 */
+			OutputScheduler(DataSink& sink, const unsigned long *bounds, unsigned int nClasses);
+
+			/**
+			 * \brief   Destructor; messages that are still queued are written out first.
+			 */
+			~OutputScheduler();
+
+			/**
+			 * \brief   Queue a message for the sink.
+			 *
+			 * \details Waits for up to \c ms milliseconds for room in the message's class; a
+			 *          timeout of 0 doesn't wait at all, and a negative timeout (the default)
+			 *          waits indefinitely.
+			 *
+			 * \returns IO_OK if the message has been queued, IO_TIMEOUT if there wasn't room in
+			 *          time, or IO_FAILURE if the sink has failed (see failed())
+			 *
+			 * \exception InvalidClass is thrown when there's no such class
+			 * \exception MessageTooLarge is thrown when the message exceeds its class's bound
+			 */
+			IoStatus post(unsigned int priority, const unsigned char *msg, unsigned long nBytes,
+			              int ms = -1);
+
+			/**
+			 * \brief   Wait until every message that has been queued is written out (or until
+			 *          the sink has failed).
+			 */
+			void flush();
+
+			/**
+			 * \brief   The number of bytes that are queued in a class.
+			 */
+			unsigned long queued(unsigned int priority) const;
+
+			/**
+			 * \brief   Whether the sink has failed.
+			 *
+			 * \details Once a write to the sink throws, the messages that are still queued are
+			 *          discarded, and nothing is ever written again.
+			 */
+			bool failed() const;
+
+		private:
+			// Disable copying and assignment for OutputScheduler objects.
+			OutputScheduler(const OutputScheduler&);
+			OutputScheduler& operator=(const OutputScheduler&);
+
+			// A priority class: its queued messages, oldest first.
+			struct Class
+			{
+				std::deque<std::vector<unsigned char> > messages;
+				unsigned long queued; // bytes, counting the message that's being written
+				unsigned long bound;
+			};
+
+			// The writer thread.
+			static void *run(void *arg);
+
+			// Internal state members.
+			DataSink& mSink;
+			std::vector<Class> mClasses;
+			unsigned long mPending; // messages that are queued or being written
+			bool mStopping;
+			bool mFailed;
+			mutable pthread_mutex_t mLock;
+			pthread_cond_t mWork;  // there are messages to write (or it's time to stop)
+			pthread_cond_t mSpace; // a message has been written (or the sink has failed)
+			pthread_t mThread;
+	};
+}
+
+#endif
@@ -0,0 +1,223 @@
+#include "PacketCodec.h"
+using namespace metrobotics;
+
+#include <cstring>
+using namespace std;
+
+#ifdef __x86_64__
+#include <nmmintrin.h>
+#endif
+
+// The size of the checksum that trails every payload.
+static const unsigned long CRC_SIZE = 4;
+
+// The worst-case size of n bytes after COBS encoding (without delimiters).
+static unsigned long encodedSize(unsigned long n)
+{
+	return n + n / 254 + 1;
+}
+
+namespace
+{
+	// Lookup table for the (reflected) CRC-32C polynomial.
+	struct CrcTable
+	{
+		CrcTable()
+		{
+			for (unsigned int i = 0; i < 256; ++i) {
+				unsigned int c = i;
+				for (int k = 0; k < 8; ++k) {
+					c = (c & 1) ? (c >> 1) ^ 0x82F63B78u : (c >> 1);
+				}
+				entry[i] = c;
+			}
+		}
+		unsigned int entry[256];
+	};
+
+	// An incremental COBS encoder.
+	class CobsEncoder
+	{
+		public:
+			// Start encoding into the given buffer, which must be large enough.
+			CobsEncoder(unsigned char *out)
+			:mOut(out),
+			 mCode(out),
+			 mNext(out + 1),
+			 mRun(1)
+			{
+			}
+
+			void put(const unsigned char *buf, unsigned long nBytes)
+			{
+				for (const unsigned char *end = buf + nBytes; buf != end; ++buf) {
+					if (*buf != 0) {
+						*mNext++ = *buf;
+						if (++mRun < 0xFF) {
+							continue;
+						}
+					}
+					// Close the current block (at a zero, or once it's full).
+					*mCode = mRun;
+					mCode = mNext++;
+					mRun = 1;
+				}
+			}
+
+			// Close the last block; returns the size of the encoding.
+			unsigned long finish()
+			{
+				*mCode = mRun;
+				return mNext - mOut;
+			}
+
+		private:
+			unsigned char *mOut;
+			unsigned char *mCode; // where the code of the current block goes
+			unsigned char *mNext;
+			unsigned char mRun;
+	};
+}
+
+// Continue computing a CRC-32C (on the inverted checksum) with a lookup table.
+static unsigned int crcTable(const unsigned char *buf, unsigned long nBytes, unsigned int crc)
+{
+	// Remarks: built on first use (thread-safe as a local static).
+	static const CrcTable table;
+	for (; nBytes > 0; ++buf, --nBytes) {
+		crc = table.entry[(crc ^ *buf) & 0xFF] ^ (crc >> 8);
+	}
+	return crc;
+}
+
+#ifdef __x86_64__
+// Continue computing a CRC-32C (on the inverted checksum) with the SSE4.2 crc32 instruction.
+// Remarks: compiled for SSE4.2 whatever the flags of the build, so it may only be called once
+// the CPU is known to have it.
+__attribute__((target("sse4.2")))
+static unsigned int crcSse42(const unsigned char *buf, unsigned long nBytes, unsigned int crc)
+{
+	unsigned long long c = crc;
+	for (; nBytes >= 8; buf += 8, nBytes -= 8) {
+		unsigned long long word;
+		memcpy(&word, buf, sizeof(word));
+		c = _mm_crc32_u64(c, word);
+	}
+	crc = (unsigned int)c;
+	for (; nBytes > 0; ++buf, --nBytes) {
+		crc = _mm_crc32_u8(crc, *buf);
+	}
+	return crc;
+}
+#endif
+
+unsigned int PacketCodec::checksum(const unsigned char *buf, unsigned long nBytes, unsigned int crc)
+{
+#ifdef __x86_64__
+	static const bool sse42 = __builtin_cpu_supports("sse4.2");
+	if (sse42) {
+		return ~crcSse42(buf, nBytes, ~crc);
+	}
+#endif
+	return ~crcTable(buf, nBytes, ~crc);
+}
+
+// Decode COBS in place; returns the decoded size, or -1 if the encoding is malformed.
+static long cobsDecode(unsigned char *buf, unsigned long nBytes)
+{
+	unsigned long in = 0;
+	unsigned long out = 0;
+	while (in < nBytes) {
+		unsigned char code = buf[in++];
+		if (code == 0 || in + code - 1 > nBytes) {
+			return -1;
+		}
+		// Remarks: the decoded data never catches up with the encoded data, so in place is safe.
+		memmove(buf + out, buf + in, code - 1);
+		in += code - 1;
+		out += code - 1;
+		if (code < 0xFF && in < nBytes) {
+			buf[out++] = 0;
+		}
+	}
+	return out;
+}
+
+PacketCodec::PacketCodec(DataSource& source, DataSink& sink, unsigned long maxPayload)
+:mSource(source),
+ mSink(sink),
+ mMaxPayload(maxPayload),
+ mDropped(0),
+ mRxBuf(encodedSize(maxPayload + CRC_SIZE) + 1),
+ mTxBuf(encodedSize(maxPayload + CRC_SIZE) + 2)
+{
+}
+
+void PacketCodec::send(const unsigned char *payload, unsigned long nBytes)
+{
+	if (payload == 0 && nBytes > 0) {
+		throw Serial::NullPointer();
+	}
+	if (nBytes > mMaxPayload) {
+		throw PacketTooLarge();
+	}
+	unsigned int crc = checksum(payload, nBytes);
+	unsigned char trailer[CRC_SIZE];
+	for (unsigned long i = 0; i < CRC_SIZE; ++i) {
+		trailer[i] = (crc >> (8 * i)) & 0xFF;
+	}
+	// Remarks: the leading delimiter lets the receiver resynchronize right away should the
+	// previous packet have been cut short.
+	mTxBuf[0] = 0;
+	CobsEncoder cobs(&mTxBuf[1]);
+	cobs.put(payload, nBytes);
+	cobs.put(trailer, CRC_SIZE);
+	unsigned long n = cobs.finish() + 1;
+	mTxBuf[n++] = 0;
+	mSink.putBlock(&mTxBuf[0], n);
+	mSink.commitOutput();
+}
+
+PacketCodec::Packet PacketCodec::receive()
+{
+	unsigned char *buf = &mRxBuf[0];
+	unsigned long size = mRxBuf.size();
+	for (;;) {
+		unsigned long n = mSource.getDelimited(buf, size, 0);
+		// Too long to be one of ours: skip ahead to the next delimiter.
+		if (buf[n - 1] != 0) {
+			while (n == size && buf[n - 1] != 0) {
+				n = mSource.getDelimited(buf, size, 0);
+			}
+			++mDropped;
+			continue;
+		}
+		// Back-to-back delimiters are just padding.
+		if (n == 1) {
+			continue;
+		}
+		long decoded = cobsDecode(buf, n - 1);
+		if (decoded < (long)CRC_SIZE) {
+			++mDropped;
+			continue;
+		}
+		unsigned long length = decoded - CRC_SIZE;
+		unsigned int crc = 0;
+		for (unsigned long i = 0; i < CRC_SIZE; ++i) {
+			crc |= (unsigned int)buf[length + i] << (8 * i);
+		}
+		if (crc != checksum(buf, length)) {
+			++mDropped;
+			continue;
+		}
+		Packet packet;
+		packet.data = buf;
+		packet.size = length;
+		return packet;
+	}
+}
+
+unsigned long PacketCodec::dropped() const
+{
+	return mDropped;
+}
@@ -0,0 +1,99 @@
+#ifndef METROBOTICS_PACKETCODEC_H
+#define METROBOTICS_PACKETCODEC_H
+
+#include "Serial.h"
+#include <vector>
+
+namespace metrobotics
+{
+	/**
+	 * \class   PacketCodec
+	 *
+	 * \brief   Sends and receives checksummed binary packets over a byte stream.
+	 *
+	 * \details Each packet's payload is followed by its CRC-32C checksum, and the two are then
+	 *          encoded with Consistent Overhead Byte Stuffing (COBS), which removes every zero
+	 *          byte at the cost of one extra byte per 254. That leaves the zero byte free to
+	 *          delimit packets on the wire:
+	 *          \code
+	 *              0x00  COBS(payload + CRC-32C, little-endian)  0x00
+	 *          \endcode
+	 *          A receiver that joins mid-stream, or that sees a corrupted packet, resynchronizes
+	 *          at the very next zero byte. Input is gathered with DataSource::getDelimited(),
+	 *          so a buffered source finds the delimiters with a bulk scan rather than with a
+	 *          virtual call per byte.
+	 *
+	 *          On x86-64, the checksum is computed with the SSE4.2 \c crc32 instruction when the
+	 *          CPU has it (which is checked at run time), and with a lookup table otherwise.
+	 */
+	class PacketCodec
+	{
+		public:
+			/**
+			 * \brief   A received packet.
+			 *
+			 * \details A view of the payload within the codec's own receive buffer; it remains
+			 *          valid until the next call to receive().
+			 */
+			struct Packet
+			{
+				const unsigned char *data;
+				unsigned long size;
+			};
+
+			// [Exceptions.]
+			class PacketTooLarge {};
+
+			/**
+			 * \brief   Construct a codec over the given input and output.
+			 *
+			 * \details For a Serial device, simply pass the same object twice.
+			 *
+			 * \arg     maxPayload is the size (in bytes) of the largest payload that may be sent
+			 *          or received; larger incoming packets are discarded
+			 */
+			PacketCodec(DataSource& source, DataSink& sink, unsigned long maxPayload = 1024);
+
+			/**
+			 * \brief   Encode and send a packet.
+			 *
+			 * \details The whole packet is handed to the sink with a single putBlock(), after
+			 *          which the sink's output is committed.
+			 *
+			 * \exception PacketTooLarge is thrown when the payload exceeds the maximum size
+			 */
+			void send(const unsigned char *payload, unsigned long nBytes);
+
+			/**
+			 * \brief   Receive the next intact packet.
+			 *
+			 * \details Blocks (as the source does) until a packet with a valid checksum arrives;
+			 *          anything else on the way is skipped and counted by dropped().
+			 */
+			Packet receive();
+
+			/**
+			 * \brief   The number of corrupted or oversized packets that have been skipped.
+			 */
+			unsigned long dropped() const;
+
+			/**
+			 * \brief   Compute (or continue computing) the CRC-32C checksum of a block.
+			 *
+			 * \arg     crc is the checksum of the preceding data, if any
+			 */
+			static unsigned int checksum(const unsigned char *buf, unsigned long nBytes,
+			                             unsigned int crc = 0);
+
+		private:
+			// Internal state members.
+			DataSource& mSource;
+			DataSink& mSink;
+			unsigned long mMaxPayload;
+			unsigned long mDropped;
+			std::vector<unsigned char> mRxBuf;
+			std::vector<unsigned char> mTxBuf;
+	};
+}
+
+#endif
@@ -0,0 +1,298 @@
+#include "Pipeline.h"
+#include "Timer/MonotonicTimer.h"
+using namespace metrobotics;
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+using namespace std;
+
+// How long (in milliseconds) run() waits for input at a time, between looking whether it has
+// been stopped.
+static const int STOP_CHECK = 50;
+
+// A reply that has been matched to its request (and taken out of the input).
+struct Arrival
+{
+	unsigned long tag;
+	unsigned long offset; // where the reply starts among the poll's replies
+	unsigned long nBytes;
+};
+
+Pipeline::Pipeline(DataSource& source, DataSink& sink, Protocol& protocol,
+                   unsigned long depth, unsigned long maxReply)
+:mSource(source),
+ mSink(sink),
+ mProtocol(protocol),
+ mDepth(max(depth, 1UL)),
+ mRxBuf(max(maxReply, 1UL)),
+ mRxTail(0),
+ mNextId(0),
+ mUnmatched(0),
+ mRunning(false),
+ mStopped(false)
+{
+	pthread_mutex_init(&mLock, 0);
+	pthread_mutex_init(&mSendLock, 0);
+	pthread_cond_init(&mSlotFree, 0);
+}
+
+Pipeline::~Pipeline()
+{
+	expire(IO_CANCELLED, true);
+	pthread_cond_destroy(&mSlotFree);
+	pthread_mutex_destroy(&mSendLock);
+	pthread_mutex_destroy(&mLock);
+}
+
+void Pipeline::submit(unsigned long tag, const unsigned char *request, unsigned long nBytes,
+                      unsigned int ms, Callback& callback)
+{
+	send(tag, request, nBytes, ms, &callback, 0);
+}
+
+future<Pipeline::Reply> Pipeline::submit(unsigned long tag, const unsigned char *request,
+                                         unsigned long nBytes, unsigned int ms)
+{
+	promise<Reply> *p = new promise<Reply>();
+	future<Reply> f = p->get_future();
+	send(tag, request, nBytes, ms, 0, p);
+	return f;
+}
+
+void Pipeline::send(unsigned long tag, const unsigned char *request, unsigned long nBytes,
+                    unsigned int ms, Callback *callback, promise<Reply> *promise)
+{
+	if (request == 0) {
+		delete promise;
+		throw Serial::NullPointer();
+	}
+
+	// Wait for a free slot; unless run() is busy receiving replies on another thread, receive
+	// them right here.
+	pthread_mutex_lock(&mLock);
+	while (mRequests.size() >= mDepth) {
+		if (mRunning && !pthread_equal(mRunner, pthread_self())) {
+			pthread_cond_wait(&mSlotFree, &mLock);
+			continue;
+		}
+		pthread_mutex_unlock(&mLock);
+		try {
+			poll();
+		} catch (...) {
+			delete promise;
+			throw;
+		}
+		pthread_mutex_lock(&mLock);
+	}
+	if (mRequests.count(tag) != 0) {
+		pthread_mutex_unlock(&mLock);
+		delete promise;
+		throw TagInUse();
+	}
+	// Remarks: the request is registered before it goes out, lest its reply beat it to it.
+	Request& r = mRequests[tag];
+	unsigned long long id = r.id = mNextId++;
+	r.deadline = ms == 0 ? 0 : MonotonicTimer::now() + ms * 1000000LL;
+	r.callback = callback;
+	r.promise = promise;
+	pthread_mutex_unlock(&mLock);
+
+	pthread_mutex_lock(&mSendLock);
+	try {
+		mSink.putBlock(request, nBytes);
+		mSink.commitOutput();
+	} catch (...) {
+		pthread_mutex_unlock(&mSendLock);
+		// Take the request back, unless it has timed out (and been completed) in the meantime.
+		pthread_mutex_lock(&mLock);
+		map<unsigned long, Request>::iterator it = mRequests.find(tag);
+		bool registered = it != mRequests.end() && it->second.id == id;
+		if (registered) {
+			mRequests.erase(it);
+			pthread_cond_broadcast(&mSlotFree);
+		}
+		pthread_mutex_unlock(&mLock);
+		if (registered) {
+			delete promise;
+		}
+		throw;
+	}
+	pthread_mutex_unlock(&mSendLock);
+}
+
+unsigned int Pipeline::poll(int ms)
+{
+	// Wait no longer than until the next request's time runs out.
+	long long next = 0;
+	pthread_mutex_lock(&mLock);
+	for (map<unsigned long, Request>::iterator it = mRequests.begin(); it != mRequests.end(); ++it) {
+		if (it->second.deadline != 0 && (next == 0 || it->second.deadline < next)) {
+			next = it->second.deadline;
+		}
+	}
+	pthread_mutex_unlock(&mLock);
+	if (next != 0) {
+		long long left = next - MonotonicTimer::now();
+		int until = left <= 0 ? 0 : (int)min((left + 999999) / 1000000, (long long)INT_MAX);
+		if (ms < 0 || until < ms) {
+			ms = until;
+		}
+	}
+	IoResult r = mSource.readSome(&mRxBuf[mRxTail], mRxBuf.size() - mRxTail, ms);
+	mRxTail += r.nBytes;
+
+	// Take the replies that have arrived in full out of the input before completing any
+	// requests, since the callbacks may well receive more input themselves.
+	vector<Arrival> arrivals;
+	vector<Request> requests;
+	vector<unsigned char> replies;
+	unsigned long head = 0;
+	while (head < mRxTail) {
+		const unsigned char *reply = &mRxBuf[head];
+		unsigned long n = mProtocol.frame(reply, mRxTail - head);
+		if (n == 0 || n > mRxTail - head) {
+			break;
+		}
+		head += n;
+		unsigned long tag;
+		if (!mProtocol.tag(reply, n, tag)) {
+			++mUnmatched;
+			continue;
+		}
+		pthread_mutex_lock(&mLock);
+		map<unsigned long, Request>::iterator it = mRequests.find(tag);
+		if (it == mRequests.end()) {
+			pthread_mutex_unlock(&mLock);
+			++mUnmatched;
+			continue;
+		}
+		requests.push_back(it->second);
+		mRequests.erase(it);
+		pthread_cond_broadcast(&mSlotFree);
+		pthread_mutex_unlock(&mLock);
+		Arrival a;
+		a.tag = tag;
+		a.offset = replies.size();
+		a.nBytes = n;
+		arrivals.push_back(a);
+		replies.insert(replies.end(), reply, reply + n);
+	}
+	// Input that fills the whole buffer without making up a reply is beyond saving.
+	if (head == 0 && mRxTail == mRxBuf.size()) {
+		++mUnmatched;
+		head = mRxTail;
+	}
+	memmove(&mRxBuf[0], &mRxBuf[head], mRxTail - head);
+	mRxTail -= head;
+
+	// Remarks: callbacks mustn't throw, or the replies after theirs get lost.
+	for (unsigned long i = 0; i < arrivals.size(); ++i) {
+		deliver(arrivals[i].tag, requests[i], IO_OK, &replies[arrivals[i].offset], arrivals[i].nBytes);
+	}
+	unsigned int completed = arrivals.size();
+	if (r.status == IO_FAILURE) {
+		expire(IO_FAILURE, true);
+		throw Serial::ReadFailure();
+	}
+	return completed + expire(IO_TIMEOUT, false);
+}
+
+void Pipeline::run()
+{
+	pthread_mutex_lock(&mLock);
+	mRunning = true;
+	mRunner = pthread_self();
+	pthread_mutex_unlock(&mLock);
+	try {
+		// Remarks: a source that has nothing to say would otherwise keep us waiting for as long
+		// as its own timeout, which may well be forever, whatever stop() says.
+		while (!mStopped) {
+			poll(STOP_CHECK);
+		}
+	} catch (...) {
+		pthread_mutex_lock(&mLock);
+		mRunning = false;
+		pthread_cond_broadcast(&mSlotFree);
+		pthread_mutex_unlock(&mLock);
+		mStopped = false;
+		throw;
+	}
+	// Remarks: whoever is waiting for a slot has to receive the replies from now on.
+	pthread_mutex_lock(&mLock);
+	mRunning = false;
+	pthread_cond_broadcast(&mSlotFree);
+	pthread_mutex_unlock(&mLock);
+	// Remarks: a stop() that comes before run() still counts.
+	mStopped = false;
+}
+
+void Pipeline::stop()
+{
+	mStopped = true;
+}
+
+void Pipeline::drain()
+{
+	while (outstanding() > 0) {
+		poll();
+	}
+}
+
+unsigned long Pipeline::outstanding() const
+{
+	pthread_mutex_lock(&mLock);
+	unsigned long n = mRequests.size();
+	pthread_mutex_unlock(&mLock);
+	return n;
+}
+
+unsigned long Pipeline::unmatched() const
+{
+	return mUnmatched;
+}
+
+void Pipeline::deliver(unsigned long tag, const Request& request, IoStatus status,
+                       const unsigned char *reply, unsigned long nBytes)
+{
+	if (request.callback != 0) {
+		if (status == IO_OK) {
+			request.callback->completed(tag, reply, nBytes);
+		} else {
+			request.callback->failed(tag, status);
+		}
+		return;
+	}
+	Reply r;
+	r.tag = tag;
+	r.status = status;
+	if (status == IO_OK) {
+		r.data.assign(reply, reply + nBytes);
+	}
+	request.promise->set_value(r);
+	delete request.promise;
+}
+
+unsigned int Pipeline::expire(IoStatus status, bool all)
+{
+	vector<pair<unsigned long, Request> > expired;
+	long long t = MonotonicTimer::now();
+	pthread_mutex_lock(&mLock);
+	map<unsigned long, Request>::iterator it = mRequests.begin();
+	while (it != mRequests.end()) {
+		if (all || (it->second.deadline != 0 && it->second.deadline <= t)) {
+			expired.push_back(*it);
+			mRequests.erase(it++);
+		} else {
+			++it;
+		}
+	}
+	if (!expired.empty()) {
+		pthread_cond_broadcast(&mSlotFree);
+	}
+	pthread_mutex_unlock(&mLock);
+	for (unsigned long i = 0; i < expired.size(); ++i) {
+		deliver(expired[i].first, expired[i].second, status, 0, 0);
+	}
+	return expired.size();
+}
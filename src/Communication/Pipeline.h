@@ -0,0 +1,233 @@
+#ifndef METROBOTICS_PIPELINE_H
+#define METROBOTICS_PIPELINE_H
+
+#include "Serial.h"
+#include <atomic>
+#include <future>
+#include <map>
+#include <vector>
+#include <pthread.h>
+
+namespace metrobotics
+{
+	/**
+	 * \class   Pipeline
+	 *
+	 * \brief   Keeps several tagged requests to a device outstanding at once.
+	 *
+	 * \details Rather than sending a command and then waiting for its reply before sending the
+	 *          next one, a pipeline sends up to \em depth commands back to back, and matches the
+	 *          replies to the commands as they come in by the tag that each reply carries. That
+	 *          way, the link stays busy instead of sitting idle for most of every round trip.
+	 *
+	 *          The pipeline knows nothing about the device's protocol: the requests that are
+	 *          submitted are sent as they are, and a Protocol tells where each reply ends and
+	 *          what its tag is. Each request is completed either through a Callback or through
+	 *          a future, with its reply or with the reason why there isn't any (e.g. that its
+	 *          timeout ran out, which has no bearing on the requests behind it). Replies that
+	 *          match no outstanding request (e.g. replies that come in after their request has
+	 *          timed out) are dropped and counted.
+	 *
+	 *          Replies are received, and requests are completed, by whichever thread calls
+	 *          poll() (or run(), or drain()). Requests may be submitted from that thread, or
+	 *          from any other thread while one thread is busy in run(); should the pipeline be
+	 *          full, submit() waits for a reply first (receiving it itself, unless run() is busy
+	 *          receiving).
+	 *
+	 * \warning poll(), run() and drain() must be called by no more than one thread at a time.
+	 *          When requests are submitted from other threads, the device has to allow one
+	 *          thread to read from it while another writes to it (as PosixSerial does).
+	 */
+	class Pipeline
+	{
+		public:
+			/**
+			 * \brief   Tells where replies end and which requests they belong to.
+			 */
+			class Protocol
+			{
+				public:
+					virtual ~Protocol() {}
+
+					/**
+					 * \brief   Find the end of the reply at the start of the given input.
+					 *
+					 * \returns the length of the reply (in bytes), or 0 if the reply hasn't
+					 *          arrived in full yet
+					 */
+					virtual unsigned long frame(const unsigned char *buf, unsigned long nBytes) = 0;
+
+					/**
+					 * \brief   Extract the tag of a reply.
+					 *
+					 * \returns false if the reply carries no tag (in which case it's dropped)
+					 */
+					virtual bool tag(const unsigned char *reply, unsigned long nBytes,
+					                 unsigned long& tag) = 0;
+			};
+
+			/**
+			 * \brief   Receives the outcome of a request.
+			 */
+			class Callback
+			{
+				public:
+					virtual ~Callback() {}
+
+					/**
+					 * \brief   The request's reply has arrived.
+					 *
+					 * \details The reply is only valid for the duration of the call.
+					 */
+					virtual void completed(unsigned long tag, const unsigned char *reply,
+					                       unsigned long nBytes) = 0;
+
+					/**
+					 * \brief   The request has failed with IO_TIMEOUT (its timeout ran out),
+					 *          IO_FAILURE (the device failed) or IO_CANCELLED (the pipeline
+					 *          was destroyed).
+					 */
+					virtual void failed(unsigned long tag, IoStatus status) = 0;
+			};
+
+			/**
+			 * \brief   The outcome of a request, as delivered through a future.
+			 */
+			struct Reply
+			{
+				unsigned long tag;
+				IoStatus status; // IO_OK if the reply has arrived (see Callback::failed())
+				std::vector<unsigned char> data;
+			};
+
+			// [Exceptions.]
+			class TagInUse {};
+
+			/**
+			 * \brief   Construct a pipeline over the given input and output.
+			 *
+			 * \details For a Serial device, simply pass the same object twice.
+			 *
+			 * \arg     depth is the maximum number of requests that are outstanding at once
+			 * \arg     maxReply is the size (in bytes) of the largest reply; input that runs
+			 *          longer without making up a reply is dropped (and counted as unmatched)
+			 */
+			Pipeline(DataSource& source, DataSink& sink, Protocol& protocol,
+			         unsigned long depth = 8, unsigned long maxReply = 1024);
+
+			/**
+			 * \brief   Destructor; requests that are still outstanding fail with IO_CANCELLED.
+			 */
+			~Pipeline();
+
+			/**
+			 * \brief   Send a request, and have its outcome delivered to a callback.
+			 *
+			 * \arg     tag identifies the request; it must be the tag that its reply will carry
+			 * \arg     ms is the time (in milliseconds) that the request has for its reply; 0
+			 *          means that it may wait indefinitely
+			 *
+			 * \exception TagInUse is thrown when a request with the same tag is outstanding
+			 */
+			void submit(unsigned long tag, const unsigned char *request, unsigned long nBytes,
+			            unsigned int ms, Callback& callback);
+
+			/**
+			 * \brief   Send a request, and have its outcome delivered through a future.
+			 *
+			 * \details Mind that somebody has to receive the reply (see drain() and run())
+			 *          before the future can be ready.
+			 */
+			std::future<Reply> submit(unsigned long tag, const unsigned char *request,
+			                          unsigned long nBytes, unsigned int ms = 0);
+
+			/**
+			 * \brief   Receive replies (and complete requests) once.
+			 *
+			 * \details Waits for up to \c ms milliseconds for input, but never past the next
+			 *          request's timeout; a negative value waits for as long as the source's own
+			 *          timeout allows. Should the source fail, every outstanding request fails
+			 *          with it, and the source's ReadFailure is thrown.
+			 *
+			 * \returns the number of requests that were completed (or failed)
+			 */
+			unsigned int poll(int ms = -1);
+
+			/**
+			 * \brief   Keep receiving replies until stop() is called.
+			 *
+			 * \details Waits for input a little at a time (50 ms at most), so that a stop()
+			 *          is noticed even while the device has nothing to say. That relies on the
+			 *          source honoring readSome()'s timeout, as PosixSerial and SharedSerial do.
+			 */
+			void run();
+
+			/**
+			 * \brief   Make run() return once its current poll() does.
+			 *
+			 * \details Safe to call from any thread, including from within a callback; run()
+			 *          returns within 50 ms or so (see run()).
+			 */
+			void stop();
+
+			/**
+			 * \brief   Receive replies until no request is outstanding anymore.
+			 */
+			void drain();
+
+			/**
+			 * \brief   The number of outstanding requests.
+			 */
+			unsigned long outstanding() const;
+
+			/**
+			 * \brief   The number of replies that matched no outstanding request.
+			 */
+			unsigned long unmatched() const;
+
+		private:
+			// Disable copying and assignment for Pipeline objects.
+			Pipeline(const Pipeline&);
+			Pipeline& operator=(const Pipeline&);
+
+			// An outstanding request.
+			struct Request
+			{
+				unsigned long long id;
+				long long deadline; // in nanoseconds; 0 means never
+				Callback *callback;
+				std::promise<Reply> *promise; // if there's no callback
+			};
+
+			// Send a request that has been set up.
+			void send(unsigned long tag, const unsigned char *request, unsigned long nBytes,
+			          unsigned int ms, Callback *callback, std::promise<Reply> *promise);
+
+			// Deliver the outcome of a request that is no longer outstanding.
+			static void deliver(unsigned long tag, const Request& request, IoStatus status,
+			                    const unsigned char *reply, unsigned long nBytes);
+
+			// Take all outstanding requests whose time has run out (or all of them, if all is
+			// set) out of the pipeline, and fail them with the given status.
+			unsigned int expire(IoStatus status, bool all);
+
+			// Internal state members.
+			DataSource& mSource;
+			DataSink& mSink;
+			Protocol& mProtocol;
+			unsigned long mDepth;
+			std::vector<unsigned char> mRxBuf;
+			unsigned long mRxTail; // received input is at [0, mRxTail)
+			std::map<unsigned long, Request> mRequests; // outstanding, by tag
+			unsigned long long mNextId;
+			std::atomic<unsigned long> mUnmatched;
+			mutable pthread_mutex_t mLock;  // guards mRequests, mNextId and mRunning
+			pthread_mutex_t mSendLock;      // keeps requests from different threads apart
+			pthread_cond_t mSlotFree;
+			bool mRunning;                  // whether some thread is busy in run()
+			pthread_t mRunner;
+			std::atomic<bool> mStopped;
+	};
+}
+
+#endif
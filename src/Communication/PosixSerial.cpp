@@ -12,21 +12,53 @@
 /************************************************************************/
 
 #include "PosixSerial.h"
-#include "Timer/PosixTimer.h"
+#include "ByteRing.h"
+#include "Timer/MonotonicTimer.h"
 using namespace metrobotics;
 
 #include <iostream>
 #include <string>
+#include <vector>
+#include <algorithm>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <cerrno>
+#include <atomic>
 using namespace std;
 
 #include <fcntl.h>
 #include <unistd.h>
 #include <termios.h>
-#include <signal.h>
+#include <poll.h>
+#include <limits.h>
+#include <sys/uio.h>
+#include <sys/ioctl.h>
+#include <pthread.h>
+#ifdef __linux__
+#include <linux/serial.h>
+#endif
+
+// Linux accepts any baud rate through its termios2 interface, whose header clashes with
+// <termios.h>; so the structure is spelled out here, with the layout of the generic ABI.
+#if defined(__linux__) && defined(TCGETS2) && (defined(__x86_64__) || defined(__i386__) || \
+    defined(__arm__) || defined(__aarch64__) || defined(__riscv))
+#define HAVE_TERMIOS2
+struct termios2
+{
+	tcflag_t c_iflag;
+	tcflag_t c_oflag;
+	tcflag_t c_cflag;
+	tcflag_t c_lflag;
+	cc_t c_line;
+	cc_t c_cc[19];
+	speed_t c_ispeed;
+	speed_t c_ospeed;
+};
+#ifndef BOTHER
+#define BOTHER 0010000
+#endif
+#endif
 
 // Debugging is off by default.
 static bool fDebugPosixSerial = false;
@@ -41,70 +73,598 @@ void PosixSerial::debugging(bool flag)
 	fDebugPosixSerial = flag;
 }
 
-// Internal signal handler for any I/O events on the device.
-static void __sighandler(int sig)
+// The standard baud rates and their speed constants.
+static const struct
+{
+	unsigned int rate;
+	speed_t speed;
+} SPEEDS[] = {
+	{ 0, B0 }, { 50, B50 }, { 75, B75 }, { 110, B110 }, { 134, B134 }, { 150, B150 },
+	{ 200, B200 }, { 300, B300 }, { 600, B600 }, { 1200, B1200 }, { 1800, B1800 },
+	{ 2400, B2400 }, { 4800, B4800 }, { 9600, B9600 }, { 19200, B19200 }, { 38400, B38400 },
+	{ 57600, B57600 }, { 115200, B115200 }, { 230400, B230400 },
+#ifdef B460800
+	{ 460800, B460800 },
+#endif
+#ifdef B500000
+	{ 500000, B500000 }, { 576000, B576000 }, { 921600, B921600 }, { 1000000, B1000000 },
+	{ 1152000, B1152000 }, { 1500000, B1500000 }, { 2000000, B2000000 },
+#endif
+#ifdef B2500000
+	{ 2500000, B2500000 }, { 3000000, B3000000 }, { 3500000, B3500000 },
+	{ 4000000, B4000000 },
+#endif
+};
+static const size_t NUM_SPEEDS = sizeof(SPEEDS) / sizeof(SPEEDS[0]);
+
+// Find the speed constant for a baud rate, which may be given as a speed constant already.
+// Remarks: the constants and the rates that they stand for never overlap (except for 0).
+static bool speed_constant(unsigned int rate, speed_t& speed)
 {
-	// Not sure if this can be used for something useful.
+	for (size_t i = 0; i < NUM_SPEEDS; ++i) {
+		if (rate == SPEEDS[i].rate || rate == SPEEDS[i].speed) {
+			speed = SPEEDS[i].speed;
+			return true;
+		}
+	}
+	return false;
 }
 
-// A persistent write function.
-static ssize_t write_r(int fd, const void *buf, size_t count, size_t ms)
+// Create a pipe whose ends never block (and don't leak into child processes).
+static bool make_pipe(int fds[2])
+{
+	if (pipe(fds) < 0) {
+		return false;
+	}
+	for (int i = 0; i < 2; ++i) {
+		fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+		fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+	}
+	return true;
+}
+
+// Wake up whoever is waiting on the read end of a pipe.
+// Remarks: a full pipe has plenty of wake-ups in it already.
+static void wake(int fd)
+{
+	const char b = 0;
+	while (write(fd, &b, 1) < 0 && errno == EINTR);
+}
+
+// Take all the pending wake-ups out of a pipe.
+static void drain(int fd)
 {
-	double tMax = ms / 1000.0; // convert to seconds
-	PosixTimer t;
+	char buf[64];
+	ssize_t r;
+	while ((r = read(fd, buf, sizeof(buf))) > 0 || (r < 0 && errno == EINTR));
+}
+
+namespace
+{
+	// Live counters for the traffic in one direction (see PosixSerial::Metrics::Channel).
+	// Remarks: each counter only ever has one writer at a time (the port's owner, or the reader
+	// thread of asynchronous input), so it's bumped with a plain load and store rather than a
+	// locked read-modify-write; being atomic merely lets other threads read it safely. The one
+	// exception is interrupted, which both may bump at once (but signals are rare anyway).
+	struct ChannelCounters
+	{
+		atomic<unsigned long long> bytes;
+		atomic<unsigned long long> syscalls;
+		atomic<unsigned long long> wouldBlock;
+		atomic<unsigned long long> interrupted;
+		atomic<unsigned long long> timeouts;
+		atomic<unsigned long long> waits[PosixSerial::Metrics::HISTOGRAM_SIZE];
+
+		// Time (in nanoseconds) that the current call has spent blocked so far.
+		// Remarks: only ever touched by the port's owner.
+		long long blocked;
+	};
+
+	// Add to a single-writer counter.
+	inline void bump(atomic<unsigned long long>& counter, unsigned long long n = 1)
+	{
+		counter.store(counter.load(memory_order_relaxed) + n, memory_order_relaxed);
+	}
+
+	// Account for a read or write that has just been issued to the device (errno is kept).
+	inline void count_syscall(ChannelCounters& c, ssize_t r)
+	{
+		bump(c.syscalls);
+		if (r > 0) {
+			bump(c.bytes, r);
+		} else if (r == 0 || errno == EAGAIN) {
+			// Remarks: without VMIN and VTIME, an empty read returns 0 rather than EAGAIN.
+			bump(c.wouldBlock);
+		} else if (r < 0 && errno == EINTR) {
+			c.interrupted.fetch_add(1, memory_order_relaxed);
+		}
+	}
+
+	// Adds up how long a call spends blocked, and enters it into the histogram if it blocked
+	// at all (whether the call succeeds or not).
+	// Remarks: the clock is only read around actual waits, which cost far more anyway.
+	class WaitTimer
+	{
+		public:
+			explicit WaitTimer(ChannelCounters& c)
+			:mCounters(c)
+			{
+				mCounters.blocked = 0;
+			}
+
+			~WaitTimer()
+			{
+				if (mCounters.blocked > 0) {
+					unsigned long long us = mCounters.blocked / 1000;
+					int i = us > 0 ? 63 - __builtin_clzll(us) : 0;
+					bump(mCounters.waits[min(i, (int)PosixSerial::Metrics::HISTOGRAM_SIZE - 1)]);
+				}
+			}
+
+		private:
+			ChannelCounters& mCounters;
+	};
+}
+
+// Live I/O metrics of a port.
+struct PosixSerial::Counters
+{
+	ChannelCounters input;
+	ChannelCounters output;
+	atomic<unsigned long long> connections;
+};
+
+// The number of timestamps that the reader of asynchronous input can note ahead of the consumer.
+static const unsigned long STAMPS = 1024;
+
+// The number of blocks that putBlocks() hands to each writev() (well below IOV_MAX).
+static const int WRITE_SLICE = 16;
+
+// What poll_r() returns when the wait has been cancelled.
+static const int CANCELLED = -2;
+
+// Wait (in the kernel) until the device is ready for the requested events, or until the wait is
+// cancelled through the read end of the given pipe (see PosixSerial::cancel()).
+// The wait is bounded by the given number of milliseconds; a negative value may wait indefinitely.
+// Returns the events that are ready, 0 if we ran out of time, CANCELLED, or -1 on failure.
+static int poll_r(int fd, short events, int ms, int cancel, ChannelCounters& c)
+{
+	struct pollfd pfd[2];
+	pfd[0].fd = fd;
+	pfd[0].events = events;
+	pfd[0].revents = 0;
+	pfd[1].fd = cancel;
+	pfd[1].events = POLLIN;
+	pfd[1].revents = 0;
 	int r;
-	unsigned int written = 0;
-	while (written < count) {
-		r = write(fd, ((const unsigned char *)buf) + written, count - written);
+	long long start = ms != 0 ? MonotonicTimer::now() : 0;
+	while ((r = poll(pfd, 2, ms)) < 0 && errno == EINTR) {
+		c.interrupted.fetch_add(1, memory_order_relaxed);
+	}
+	if (ms != 0) {
+		c.blocked += MonotonicTimer::now() - start;
+	}
+	if (r < 0) {
+		return -1;
+	} else if (pfd[1].revents & POLLIN) {
+		drain(cancel);
+		return CANCELLED;
+	}
+	return r > 0 ? pfd[0].revents : 0;
+}
+
+// Time (in milliseconds) that remains before the timer exceeds the timeout; -1 means forever.
+// Remarks: a negative timeout never runs out.
+static int remaining(const MonotonicTimer& t, int ms)
+{
+	if (ms < 0) {
+		return -1;
+	}
+	long long left = ms * 1000000LL - t.elapsedNs();
+	return left > 0 ? (int)((left + 999999) / 1000000) : 0;
+}
+
+// Write whatever the device takes (at least one byte), waiting for up to ms milliseconds (or
+// indefinitely if ms is negative) for it to take anything at all; n is set to the bytes written.
+static IoStatus writev_some(int fd, const struct iovec *iov, int iovcnt, int ms, int cancel,
+                            size_t& n, ChannelCounters& c)
+{
+	MonotonicTimer t;
+	n = 0;
+	for (;;) {
+		ssize_t r = writev(fd, iov, min(iovcnt, IOV_MAX));
+		count_syscall(c, r);
 		// did something seriously go wrong?
-		if (r < 0 && errno != EINTR) {
+		if (r < 0 && errno != EINTR && errno != EAGAIN) {
 			__dbg(string("PosixSerial: failed to write: ") + string(strerror(errno)));
-			throw PosixSerial::WriteFailure();
+			return IO_FAILURE;
 		} else if (r > 0) {
 			// progress!
-			written += r;
-			t.start(); // restart the timer
+			n = r;
+			return IO_OK;
 		}
-		// are we out of time?
-		if (ms > 0 && t.elapsed() > tMax) {
+		// sleep until the device can take more data, or until we're out of time
+		int left = remaining(t, ms);
+		int ev = left == 0 ? 0 : poll_r(fd, POLLOUT, left, cancel, c);
+		if (ev == CANCELLED) {
+			return IO_CANCELLED;
+		} else if (ev < 0 || (ev & (POLLERR | POLLHUP | POLLNVAL))) {
+			__dbg(string("PosixSerial: failed to wait for output"));
+			return IO_FAILURE;
+		} else if (ev == 0) {
+			bump(c.timeouts);
+			return IO_TIMEOUT;
+		}
+	}
+}
+
+// A persistent (gathering) write function.
+static ssize_t writev_r(int fd, struct iovec *iov, int iovcnt, int ms, int cancel,
+                        ChannelCounters& c)
+{
+	ssize_t written = 0;
+	while (iovcnt > 0) {
+		// skip over whatever has been written already
+		if (iov->iov_len == 0) {
+			++iov;
+			--iovcnt;
+			continue;
+		}
+		// Remarks: the timeout restarts with every bit of progress.
+		size_t r;
+		IoStatus status = writev_some(fd, iov, iovcnt, ms, cancel, r, c);
+		if (status == IO_TIMEOUT) {
 			__dbg(string("PosixSerial: write timed out"));
 			throw PosixSerial::WriteTimeout();
+		} else if (status == IO_CANCELLED) {
+			throw PosixSerial::Cancelled();
+		} else if (status != IO_OK) {
+			throw PosixSerial::WriteFailure();
+		}
+		written += r;
+		for (; iovcnt > 0 && r >= iov->iov_len; ++iov, --iovcnt) {
+			r -= iov->iov_len;
+		}
+		if (iovcnt > 0) {
+			iov->iov_base = ((unsigned char *)iov->iov_base) + r;
+			iov->iov_len -= r;
 		}
 	}
 	return written;
 }
 
-// A persistent read function.
-static ssize_t read_r(int fd, void *buf, size_t count, size_t ms)
+// A persistent write function.
+static ssize_t write_r(int fd, const void *buf, size_t count, int ms, int cancel,
+                       ChannelCounters& c)
 {
-	double tMax = ms / 1000.0; // convert to seconds
-	PosixTimer t;
-	int r;
-	unsigned int total = 0;
-	while (total < count) {
-		r = read(fd, ((unsigned char *)buf) + total, count - total);
+	struct iovec iov;
+	iov.iov_base = const_cast<void *>(buf);
+	iov.iov_len = count;
+	return writev_r(fd, &iov, 1, ms, cancel, c);
+}
+
+// Read whatever is available (at least one byte, at most count bytes), waiting for up to ms
+// milliseconds (or indefinitely if ms is negative) for anything at all; n is set to the bytes read.
+static IoStatus read_some(int fd, void *buf, size_t count, int ms, int cancel, size_t& n,
+                          ChannelCounters& c)
+{
+	MonotonicTimer t;
+	n = 0;
+	bool hungUp = false;
+	for (;;) {
+		ssize_t r = read(fd, buf, count);
+		count_syscall(c, r);
 		// did something seriously go wrong?
-		if (r < 0 && errno != EINTR) {
+		if (r < 0 && errno != EINTR && errno != EAGAIN) {
 			__dbg(string("PosixSerial: failed to read: ") + string(strerror(errno)));
-			throw PosixSerial::ReadFailure();
+			return IO_FAILURE;
 		} else if (r > 0) {
 			// progress!
-			total += r;
-			t.start(); // restart the timer
+			n = r;
+			return IO_OK;
+		} else if (r == 0 && hungUp) {
+			// Remarks: a hang-up would otherwise wake us up forever (with or without POLLIN);
+			// whatever input was still pending has been read by now.
+			__dbg(string("PosixSerial: device hung up"));
+			return IO_FAILURE;
 		}
-		// are we out of time?
-		if (ms > 0 && t.elapsed() > tMax) {
-			__dbg(string("PosixSerial: read timed out"));
-			throw PosixSerial::ReadTimeout();
+		// sleep until the device has more data, or until we're out of time
+		int left = remaining(t, ms);
+		int ev = left == 0 ? 0 : poll_r(fd, POLLIN, left, cancel, c);
+		if (ev == CANCELLED) {
+			return IO_CANCELLED;
+		} else if (ev < 0 || (ev & (POLLERR | POLLNVAL))) {
+			__dbg(string("PosixSerial: failed to wait for input"));
+			return IO_FAILURE;
+		} else if (ev == 0) {
+			bump(c.timeouts);
+			return IO_TIMEOUT;
 		}
+		hungUp = (ev & POLLHUP) != 0;
+	}
+}
+
+// Throw the exception that corresponds to an unsuccessful read.
+static void read_failed(IoStatus status)
+{
+	if (status == IO_TIMEOUT) {
+		__dbg(string("PosixSerial: read timed out"));
+		throw PosixSerial::ReadTimeout();
+	} else if (status == IO_CANCELLED) {
+		throw PosixSerial::Cancelled();
+	}
+	throw PosixSerial::ReadFailure();
+}
+
+// State of asynchronous input: a reader thread that drains the device into a ring buffer.
+// Remarks: the reader is the ring's producer and the port's owner is its consumer; they only ever
+// signal each other when one side has to wait for the other. The consumer waits on a pipe (so
+// that its wait can be cancelled like any other), and the producer on a condition variable.
+struct PosixSerial::AsyncInput
+{
+	AsyncInput(int dev, unsigned long nBytes, ChannelCounters& c, unsigned long long position,
+	           bool stamped);
+	~AsyncInput();
+
+	// Stop the reader, whether it's waiting on the device or waiting for room in the ring.
+	void stop();
+
+	// [Consumer side.]
+	// Wait until there's input in the ring, until we're out of time (never, if ms is negative),
+	// or until the wait is cancelled through the given pipe.
+	IoStatus waitForInput(int ms, int cancel);
+	// Let the reader know that there's room in the ring.
+	void consumed();
+
+	// [Producer side.]
+	static void *run(void *arg);
+	// Let the consumer know that there's input in the ring (or that the reader has failed).
+	void produced();
+
+	// [Timestamps.]
+	// Note (on the reader's side) the arrival of a chunk of k bytes.
+	void stamp(unsigned long k);
+	// Take (on the consumer's side) the next timestamp that the reader has noted, if any.
+	bool nextStamp(Stamp& s);
+
+	int fd;
+	ByteRing ring;
+	ChannelCounters& counters;
+	int stopPipe[2];  // wakes the reader up when it's time to stop
+	int readyPipe[2]; // wakes the consumer up when there's input
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t spaceReady;
+	atomic<bool> consumerWaiting;
+	atomic<bool> producerWaiting;
+	atomic<bool> stopping;
+	atomic<bool> failed;
+
+	// Remarks: timestamps travel from the reader to the consumer through a ring of their own;
+	// should the consumer fall that far behind, the reader notes the gap in the ring's last slot
+	// (with a timestamp of 0, i.e. unknown), and stops noting chunks until there's room again.
+	atomic<bool> stamping;
+	unsigned long long received; // the position of the next byte that the reader takes
+	bool gap;                    // whether the last note in the ring is a gap
+	vector<Stamp> stamps;
+	atomic<unsigned long> stampHead;
+	atomic<unsigned long> stampTail;
+};
+
+PosixSerial::AsyncInput::AsyncInput(int dev, unsigned long nBytes, ChannelCounters& c,
+                                     unsigned long long position, bool stamped)
+:fd(dev),
+ ring(nBytes),
+ counters(c),
+ consumerWaiting(false),
+ producerWaiting(false),
+ stopping(false),
+ failed(false),
+ stamping(stamped),
+ received(position),
+ gap(false),
+ stamps(STAMPS),
+ stampHead(0),
+ stampTail(0)
+{
+	pthread_mutex_init(&lock, 0);
+	pthread_cond_init(&spaceReady, 0);
+	readyPipe[0] = readyPipe[1] = -1;
+	if (!make_pipe(stopPipe)) {
+		__dbg(string("PosixSerial: failed to create pipe: ") + string(strerror(errno)));
+		stopPipe[0] = stopPipe[1] = -1;
+	} else if (!make_pipe(readyPipe)) {
+		__dbg(string("PosixSerial: failed to create pipe: ") + string(strerror(errno)));
+		close(stopPipe[0]);
+		close(stopPipe[1]);
+		stopPipe[0] = stopPipe[1] = -1;
+	} else if ((errno = pthread_create(&thread, 0, run, this)) != 0) {
+		__dbg(string("PosixSerial: failed to start reader: ") + string(strerror(errno)));
+		close(stopPipe[0]);
+		close(stopPipe[1]);
+		close(readyPipe[0]);
+		close(readyPipe[1]);
+		stopPipe[0] = stopPipe[1] = -1;
+	}
+	if (stopPipe[0] < 0) {
+		pthread_cond_destroy(&spaceReady);
+		pthread_mutex_destroy(&lock);
+		throw PosixSerial::ConnectionFailure();
+	}
+}
+
+PosixSerial::AsyncInput::~AsyncInput()
+{
+	stop();
+	close(stopPipe[0]);
+	close(stopPipe[1]);
+	close(readyPipe[0]);
+	close(readyPipe[1]);
+	pthread_cond_destroy(&spaceReady);
+	pthread_mutex_destroy(&lock);
+}
+
+void PosixSerial::AsyncInput::stop()
+{
+	if (!stopping.exchange(true)) {
+		wake(stopPipe[1]);
+		pthread_mutex_lock(&lock);
+		pthread_cond_signal(&spaceReady);
+		pthread_mutex_unlock(&lock);
+		pthread_join(thread, 0);
 	}
-	return total;
+}
+
+IoStatus PosixSerial::AsyncInput::waitForInput(int ms, int cancel)
+{
+	MonotonicTimer t;
+	while (ring.readable() == 0 && !failed) {
+		consumerWaiting = true;
+		// Remarks: pairs with the fence in produced(); either the reader sees that we're
+		// waiting or we see whatever it has just put into the ring.
+		atomic_thread_fence(memory_order_seq_cst);
+		if (ring.readable() > 0 || failed) {
+			consumerWaiting = false;
+			break;
+		}
+		int left = remaining(t, ms);
+		int ev = left == 0 ? 0 : poll_r(readyPipe[0], POLLIN, left, cancel, counters);
+		consumerWaiting = false;
+		if (ev == CANCELLED) {
+			return IO_CANCELLED;
+		} else if (ev < 0) {
+			__dbg(string("PosixSerial: failed to wait for input"));
+			return IO_FAILURE;
+		} else if (ev == 0) {
+			bump(counters.timeouts);
+			return IO_TIMEOUT;
+		}
+		drain(readyPipe[0]);
+	}
+	if (ring.readable() == 0) {
+		__dbg(string("PosixSerial: asynchronous reader has failed"));
+		return IO_FAILURE;
+	}
+	return IO_OK;
+}
+
+void PosixSerial::AsyncInput::consumed()
+{
+	atomic_thread_fence(memory_order_seq_cst);
+	if (producerWaiting.load(memory_order_relaxed)) {
+		pthread_mutex_lock(&lock);
+		pthread_cond_signal(&spaceReady);
+		pthread_mutex_unlock(&lock);
+	}
+}
+
+void PosixSerial::AsyncInput::produced()
+{
+	atomic_thread_fence(memory_order_seq_cst);
+	if (consumerWaiting.load(memory_order_relaxed)) {
+		wake(readyPipe[1]);
+	}
+}
+
+void PosixSerial::AsyncInput::stamp(unsigned long k)
+{
+	if (stamping.load(memory_order_relaxed)) {
+		unsigned long tail = stampTail.load(memory_order_relaxed);
+		unsigned long room = STAMPS - (tail - stampHead.load(memory_order_acquire));
+		// Remarks: without a note of the gap, its chunks would pass for part of the chunk before;
+		// the note has to be there by the time its input is, just like any other timestamp.
+		if (room > 1 || (room == 1 && !gap)) {
+			stamps[tail % STAMPS].position = received;
+			stamps[tail % STAMPS].time = room > 1 ? MonotonicTimer::now() : 0;
+			stampTail.store(tail + 1, memory_order_release);
+		}
+		gap = room <= 1;
+	}
+	received += k;
+}
+
+bool PosixSerial::AsyncInput::nextStamp(Stamp& s)
+{
+	unsigned long head = stampHead.load(memory_order_relaxed);
+	if (head == stampTail.load(memory_order_acquire)) {
+		return false;
+	}
+	s = stamps[head % STAMPS];
+	stampHead.store(head + 1, memory_order_release);
+	return true;
+}
+
+void *PosixSerial::AsyncInput::run(void *arg)
+{
+	AsyncInput *self = static_cast<AsyncInput *>(arg);
+	while (!self->stopping) {
+		unsigned char *space;
+		unsigned long n = self->ring.writeSpace(&space);
+		// The consumer has fallen behind; wait for it to make room.
+		if (n == 0) {
+			pthread_mutex_lock(&self->lock);
+			self->producerWaiting = true;
+			atomic_thread_fence(memory_order_seq_cst);
+			while (self->ring.writable() == 0 && !self->stopping) {
+				pthread_cond_wait(&self->spaceReady, &self->lock);
+			}
+			self->producerWaiting = false;
+			pthread_mutex_unlock(&self->lock);
+			continue;
+		}
+		// Sleep until the device has more data (or until we're told to stop).
+		struct pollfd pfd[2];
+		pfd[0].fd = self->fd;
+		pfd[0].events = POLLIN;
+		pfd[1].fd = self->stopPipe[0];
+		pfd[1].events = POLLIN;
+		int r;
+		while ((r = poll(pfd, 2, -1)) < 0 && errno == EINTR) {
+			self->counters.interrupted.fetch_add(1, memory_order_relaxed);
+		}
+		if (r < 0 || (pfd[0].revents & (POLLERR | POLLNVAL)) || pfd[0].revents == POLLHUP) {
+			__dbg(string("PosixSerial: asynchronous reader failed to wait for input"));
+			self->failed = true;
+		} else if (pfd[0].revents & POLLIN) {
+			// Read straight into the ring.
+			ssize_t k = read(self->fd, space, n);
+			count_syscall(self->counters, k);
+			if (k > 0) {
+				// Remarks: the timestamp has to be there by the time its input is.
+				self->stamp(k);
+				self->ring.commitWrite(k);
+			} else if (k == 0 && (pfd[0].revents & POLLHUP)) {
+				// Remarks: a tty that hangs up reports POLLIN along with POLLHUP, for good.
+				__dbg(string("PosixSerial: device hung up"));
+				self->failed = true;
+			} else if (k < 0 && errno != EINTR && errno != EAGAIN) {
+				__dbg(string("PosixSerial: failed to read: ") + string(strerror(errno)));
+				self->failed = true;
+			}
+		}
+		self->produced();
+		if (self->failed) {
+			break;
+		}
+	}
+	return 0;
 }
 
 PosixSerial::PosixSerial(const char *devName, unsigned int baudRate)
 :mFunctional(false),
  mDevFD(-1),
- mLineSpeed(baudRate)
+ mConfig(baudRate),
+ mTimeOut(0),
+ mInSize(0),
+ mInHead(0),
+ mInTail(0),
+ mOutSize(0),
+ mOutTail(0),
+ mStamping(false),
+ mReceived(0),
+ mAsync(0),
+ mAsyncSize(0),
+ mCounters(0)
 {
 	if (devName == 0) {
 		__dbg(string("PosixSerial: device name cannot be null"));
@@ -112,11 +672,76 @@ PosixSerial::PosixSerial(const char *devName, unsigned int baudRate)
 	} else {
 		mDevName = devName;
 	}
-	connect();
+	// Remarks: value-initialized, so all counters start at 0.
+	mCounters = new Counters();
+	if (!make_pipe(mCancel)) {
+		__dbg(string("PosixSerial: failed to create pipe: ") + string(strerror(errno)));
+		delete mCounters;
+		throw ConnectionFailure();
+	}
+	try {
+		connect();
+	} catch (...) {
+		close(mCancel[0]);
+		close(mCancel[1]);
+		delete mCounters;
+		throw;
+	}
+}
+
+PosixSerial::PosixSerial(const char *devName, const SerialConfig& config)
+:mFunctional(false),
+ mDevFD(-1),
+ mConfig(config),
+ mTimeOut(0),
+ mInSize(0),
+ mInHead(0),
+ mInTail(0),
+ mOutSize(0),
+ mOutTail(0),
+ mStamping(false),
+ mReceived(0),
+ mAsync(0),
+ mAsyncSize(0),
+ mCounters(0)
+{
+	if (devName == 0) {
+		__dbg(string("PosixSerial: device name cannot be null"));
+		throw InvalidDeviceName();
+	} else {
+		mDevName = devName;
+	}
+	mCounters = new Counters();
+	if (!make_pipe(mCancel)) {
+		__dbg(string("PosixSerial: failed to create pipe: ") + string(strerror(errno)));
+		delete mCounters;
+		throw ConnectionFailure();
+	}
+	try {
+		connect();
+	} catch (...) {
+		close(mCancel[0]);
+		close(mCancel[1]);
+		delete mCounters;
+		throw;
+	}
+	inputBuffer(config.inputBuffer);
+	outputBuffer(config.outputBuffer);
 }
 
 PosixSerial::~PosixSerial()
 {
+	// Don't lose any output that is still being held back.
+	try {
+		commitOutput();
+	} catch (...) {
+		__dbg(string("PosixSerial: failed to commit output before closing"));
+	}
+	// The reader has to be stopped before the device goes away.
+	delete mAsync;
+	delete mCounters;
+	close(mCancel[0]);
+	close(mCancel[1]);
 	if (mFunctional && mDevFD > 0) {
 		close(mDevFD);
 	}
@@ -125,77 +750,309 @@ PosixSerial::~PosixSerial()
 void PosixSerial::connect()
 {
 	if (!mFunctional) {
-		// Intercept I/O events on the port.
-		struct sigaction sa;
-		if (sigaction(SIGIO, 0, &sa) < 0) {
-			__dbg(string("PosixSerial: failed to retrieve sigaction"));
-			throw ConnectionFailure();
-		}
-		sa.sa_handler = __sighandler;
-		if (sigaction(SIGIO, &sa, 0) < 0) {
-			__dbg(string("PosixSerial: failed to override sigaction"));
-			throw ConnectionFailure();
-		}
-
 		// Open the port.
+		// Remarks: all waiting is done with poll(), so there's no need for signals (SIGIO).
 		if ((mDevFD = open(mDevName.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK)) < 0) {
 			__dbg(string("PosixSerial: failed to open port ") + mDevName);
 			throw ConnectionFailure();
 		}
 
-		// Redirect all signals for the port to the current process.
-		if (fcntl(mDevFD, F_SETOWN, getpid()) < 0) {
-			__dbg(string("PosixSerial: failed to redirect signals: ") + string(strerror(errno)));
-			throw ConnectionFailure();
+		// Set our attributes.
+		try {
+			setAttributes(mConfig, TCSAFLUSH);
+		} catch (...) {
+			close(mDevFD);
+			mDevFD = -1;
+			throw;
 		}
 
-		// Enable asynchronous I/O for the port.
-		if (fcntl(mDevFD, F_SETFL, FASYNC) < 0) {
-			__dbg(string("PosixSerial: failed to enable asynchronous I/O: ") + string(strerror(errno)));
-			throw ConnectionFailure();
+		mFunctional = true;
+		bump(mCounters->connections);
+
+		// Restart the reader that the lost connection took down.
+		if (mAsyncSize > 0) {
+			unsigned long nBytes = mAsyncSize;
+			mAsyncSize = 0;
+			asyncInput(true, nBytes);
 		}
+	}
+}
+
+void PosixSerial::checkConnection()
+{
+	if (!mFunctional) {
+		return;
+	}
+	// Remarks: a device that has gone away reports a hang-up (or an error) for good, whether
+	// it's a pseudo-terminal whose master was closed or a USB adapter that was unplugged.
+	struct pollfd pfd;
+	pfd.fd = mDevFD;
+	pfd.events = 0;
+	pfd.revents = 0;
+	if (poll(&pfd, 1, 0) <= 0 || (pfd.revents & (POLLHUP | POLLERR | POLLNVAL)) == 0) {
+		return;
+	}
+	__dbg(string("PosixSerial: lost the connection to ") + mDevName);
+	if (mAsync != 0) {
+		mAsyncSize = mAsync->ring.capacity();
+		asyncInput(false);
+	}
+	// Output that is still being held back has nowhere to go.
+	mOutTail = 0;
+	close(mDevFD);
+	mDevFD = -1;
+	mFunctional = false;
+}
 
-		// Get the port's current attributes.
-		struct termios attr;
-		memset((void *)&attr, 0, sizeof(attr));
-		if (tcgetattr(mDevFD, &attr) < 0 ) {
+void PosixSerial::setAttributes(const SerialConfig& config, int when)
+{
+	// Get the port's current attributes.
+	struct termios attr;
+	memset((void *)&attr, 0, sizeof(attr));
+	if (tcgetattr(mDevFD, &attr) < 0 ) {
+		__dbg(string("PosixSerial: failed to acquire port attributes: ") + string(strerror(errno)));
+		throw ConnectionFailure();
+	}
+
+	// Start from "raw" mode, and then apply the line settings.
+	// Remarks: rates without a speed constant of their own are set separately.
+	cfmakeraw(&attr);
+	speed_t speed;
+	bool custom = !speed_constant(config.baudRate, speed);
+#ifndef HAVE_TERMIOS2
+	if (custom) {
+		__dbg(string("PosixSerial: non-standard baud rates are not supported"));
+		throw InvalidConfiguration();
+	}
+#endif
+	if (!custom && cfsetspeed(&attr, speed) < 0) {
+		__dbg(string("PosixSerial: unsupported baud rate"));
+		throw InvalidConfiguration();
+	}
+	attr.c_cflag &= ~(CSIZE | PARENB | PARODD | CSTOPB);
+	switch (config.charSize) {
+		case 5: attr.c_cflag |= CS5; break;
+		case 6: attr.c_cflag |= CS6; break;
+		case 7: attr.c_cflag |= CS7; break;
+		case 8: attr.c_cflag |= CS8; break;
+		default:
+			__dbg(string("PosixSerial: unsupported character size"));
+			throw InvalidConfiguration();
+	}
+	if (config.parity != SerialConfig::NO_PARITY) {
+		attr.c_cflag |= PARENB;
+		attr.c_iflag |= INPCK;
+		if (config.parity == SerialConfig::ODD_PARITY) {
+			attr.c_cflag |= PARODD;
+		}
+	}
+	if (config.stopBits == 2) {
+		attr.c_cflag |= CSTOPB;
+	} else if (config.stopBits != 1) {
+		__dbg(string("PosixSerial: unsupported number of stop bits"));
+		throw InvalidConfiguration();
+	}
+	attr.c_iflag &= ~(IXON | IXOFF | IXANY);
+#ifdef CRTSCTS
+	attr.c_cflag &= ~CRTSCTS;
+	if (config.flowControl == SerialConfig::HARDWARE_FLOW_CONTROL) {
+		attr.c_cflag |= CRTSCTS;
+	}
+#else
+	if (config.flowControl == SerialConfig::HARDWARE_FLOW_CONTROL) {
+		__dbg(string("PosixSerial: hardware flow control is not supported"));
+		throw InvalidConfiguration();
+	}
+#endif
+	if (config.flowControl == SerialConfig::SOFTWARE_FLOW_CONTROL) {
+		attr.c_iflag |= IXON | IXOFF;
+	}
+	// Remarks: the descriptor is non-blocking and every wait is a poll(), so these only make
+	// sure that read() never holds anything back.
+	attr.c_cc[VTIME] = 0; // timeout in tenths of a second
+	attr.c_cc[VMIN] = 0;  // allow read to return 0
+	if (!custom && tcsetattr(mDevFD, when, &attr) < 0) {
+		__dbg(string("PosixSerial: failed set port attributes: ") + string(strerror(errno)));
+		throw ConnectionFailure();
+	}
+#ifdef HAVE_TERMIOS2
+	// Let the driver work out how to run at any other rate.
+	if (custom) {
+		struct termios2 attr2;
+		if (ioctl(mDevFD, TCGETS2, &attr2) < 0) {
 			__dbg(string("PosixSerial: failed to acquire port attributes: ") + string(strerror(errno)));
 			throw ConnectionFailure();
 		}
+		attr2.c_iflag = attr.c_iflag;
+		attr2.c_oflag = attr.c_oflag;
+		attr2.c_cflag = (attr.c_cflag & ~(CBAUD | CIBAUD)) | BOTHER;
+		attr2.c_lflag = attr.c_lflag;
+		attr2.c_line = attr.c_line;
+		memcpy(attr2.c_cc, attr.c_cc, sizeof(attr2.c_cc));
+		attr2.c_ispeed = attr2.c_ospeed = config.baudRate;
+		int request = when == TCSANOW ? TCSETS2 : when == TCSADRAIN ? TCSETSW2 : TCSETSF2;
+		if (ioctl(mDevFD, request, &attr2) < 0) {
+			__dbg(string("PosixSerial: failed to set baud rate: ") + string(strerror(errno)));
+			throw InvalidConfiguration();
+		}
+	}
+#endif
 
-		// Set our attributes.
-		// TODO: attributes should probably be parameterized; just assume "raw" mode for now.
-		cfmakeraw(&attr);
-		cfsetspeed(&attr, mLineSpeed);
-		attr.c_cc[VTIME] = 0; // timeout in tenths of a second
-		attr.c_cc[VMIN] = 0;  // allow read to return 0
-		if (tcsetattr(mDevFD, TCSAFLUSH, &attr) < 0) {
-			__dbg(string("PosixSerial: failed set port attributes: ") + string(strerror(errno)));
-			throw ConnectionFailure();
+#ifdef __linux__
+	// Ask the driver to deliver input immediately (or to batch it as it sees fit), if asked to.
+	// Remarks: not every device supports this, but it's only ever an optimization.
+	struct serial_struct serial;
+	if (config.lowLatency == SerialConfig::LEAVE_LOW_LATENCY) {
+		// Whatever the driver does now stays.
+	} else if (ioctl(mDevFD, TIOCGSERIAL, &serial) == 0) {
+		if (config.lowLatency == SerialConfig::ENABLE_LOW_LATENCY) {
+			serial.flags |= ASYNC_LOW_LATENCY;
+		} else {
+			serial.flags &= ~ASYNC_LOW_LATENCY;
+		}
+		if (ioctl(mDevFD, TIOCSSERIAL, &serial) < 0) {
+			__dbg(string("PosixSerial: failed to set low-latency mode: ") + string(strerror(errno)));
 		}
+	} else {
+		__dbg(string("PosixSerial: low-latency mode is not supported: ") + string(strerror(errno)));
+	}
+#endif
+}
 
-		mFunctional = true;
+void PosixSerial::configure(const SerialConfig& config)
+{
+	if (!mFunctional) {
+		connect();
+	}
+	// Remarks: pending output still goes out with the old settings.
+	commitOutput();
+	setAttributes(config, TCSADRAIN);
+	mConfig = config;
+	inputBuffer(config.inputBuffer);
+	outputBuffer(config.outputBuffer);
+}
+
+const SerialConfig& PosixSerial::configuration() const
+{
+	return mConfig;
+}
+
+unsigned int PosixSerial::baudRate() const
+{
+#ifdef HAVE_TERMIOS2
+	// Remarks: the driver updates the speed to whatever it could actually achieve.
+	struct termios2 attr2;
+	if (ioctl(mDevFD, TCGETS2, &attr2) == 0) {
+		return attr2.c_ospeed;
 	}
+#endif
+	struct termios attr;
+	if (tcgetattr(mDevFD, &attr) == 0) {
+		speed_t speed = cfgetospeed(&attr);
+		for (size_t i = 0; i < NUM_SPEEDS; ++i) {
+			if (SPEEDS[i].speed == speed) {
+				return SPEEDS[i].rate;
+			}
+		}
+	}
+	__dbg(string("PosixSerial: failed to determine the baud rate"));
+	return 0;
 }
 
 void PosixSerial::putByte(const unsigned char b)
 {
+	// Fast path: there's room in the output buffer.
+	if (mOutTail < mOutSize) {
+		mOutBuf[mOutTail++] = b;
+		return;
+	}
 	putBlock(&b, 1);
 }
 
 void PosixSerial::putBlock(const unsigned char *buf, unsigned long nBytes)
 {
-	if (buf == 0) {
+	DataBlock block;
+	block.buf = buf;
+	block.nBytes = nBytes;
+	putBlocks(&block, 1);
+}
+
+void PosixSerial::putBlocks(const DataBlock *blocks, unsigned long nBlocks)
+{
+	if (blocks == 0) {
 		throw NullPointer();
 	}
+	unsigned long total = 0;
+	for (unsigned long i = 0; i < nBlocks; ++i) {
+		if (blocks[i].buf == 0 && blocks[i].nBytes > 0) {
+			throw NullPointer();
+		}
+		total += blocks[i].nBytes;
+	}
 	if (!mFunctional) {
 		connect();
 	}
-	write_r(mDevFD, buf, nBytes, mTimeOut);
+	// Hold the output back if it still fits into the buffer.
+	if (mOutTail + total <= mOutSize) {
+		for (unsigned long i = 0; i < nBlocks; ++i) {
+			memcpy(&mOutBuf[mOutTail], blocks[i].buf, blocks[i].nBytes);
+			mOutTail += blocks[i].nBytes;
+		}
+		return;
+	}
+	// Otherwise write out the pending output together with the new blocks, a slice of blocks
+	// at a time.
+	// Remarks: slicing keeps the heap out of unbuffered writes; a single writev() can't take
+	// more than IOV_MAX blocks anyway, and a handful of them already amortizes the call.
+	struct iovec iov[WRITE_SLICE];
+	int n = 0;
+	if (mOutTail > 0) {
+		iov[n].iov_base = &mOutBuf[0];
+		iov[n].iov_len = mOutTail;
+		++n;
+	}
+	mOutTail = 0;
+	WaitTimer wait(mCounters->output);
+	try {
+		unsigned long i = 0;
+		do {
+			for (; n < WRITE_SLICE && i < nBlocks; ++n, ++i) {
+				iov[n].iov_base = const_cast<unsigned char *>(blocks[i].buf);
+				iov[n].iov_len = blocks[i].nBytes;
+			}
+			writev_r(mDevFD, iov, n, waitTime(), mCancel[0], mCounters->output);
+			n = 0;
+		} while (i < nBlocks);
+	} catch (WriteFailure&) {
+		checkConnection();
+		throw;
+	}
+}
+
+void PosixSerial::commitOutput()
+{
+	if (mOutTail > 0) {
+		if (!mFunctional) {
+			connect();
+		}
+		unsigned long n = mOutTail;
+		mOutTail = 0;
+		WaitTimer wait(mCounters->output);
+		try {
+			write_r(mDevFD, &mOutBuf[0], n, waitTime(), mCancel[0], mCounters->output);
+		} catch (WriteFailure&) {
+			checkConnection();
+			throw;
+		}
+	}
 }
 
 unsigned char PosixSerial::getByte()
 {
+	// Fast path: the byte is already buffered.
+	if (mInHead < mInTail) {
+		return mInBuf[mInHead++];
+	}
 	unsigned char b;
 	getBlock(&b, 1);
 	return b;
@@ -209,7 +1066,228 @@ void PosixSerial::getBlock(unsigned char *buf, unsigned long nBytes)
 	if (!mFunctional) {
 		connect();
 	}
-	read_r(mDevFD, buf, nBytes, mTimeOut);
+	WaitTimer wait(mCounters->input);
+	while (nBytes > 0) {
+		// Hand out whatever is already buffered.
+		if (mInHead < mInTail) {
+			unsigned long n = min(nBytes, mInTail - mInHead);
+			memcpy(buf, &mInBuf[mInHead], n);
+			mInHead += n;
+			buf += n;
+			nBytes -= n;
+		// Requests that wouldn't fit into the buffer go straight to the device (or the ring).
+		} else if (nBytes >= mInSize || mAsync != 0) {
+			receiveAll(buf, nBytes);
+			nBytes = 0;
+		} else {
+			IoStatus status = fillInput(waitTime());
+			if (status != IO_OK) {
+				read_failed(status);
+			}
+		}
+	}
+}
+
+unsigned long PosixSerial::getDelimited(unsigned char *buf, unsigned long nBytes,
+                                        unsigned char delimiter)
+{
+	if (buf == 0) {
+		throw NullPointer();
+	}
+	if (!mFunctional) {
+		connect();
+	}
+	WaitTimer wait(mCounters->input);
+	unsigned long total = 0;
+	while (total < nBytes) {
+		// Scan the buffered input in bulk.
+		if (mInHead < mInTail) {
+			const unsigned char *src = &mInBuf[mInHead];
+			unsigned long n = min(nBytes - total, mInTail - mInHead);
+			const void *hit = memchr(src, delimiter, n);
+			if (hit != 0) {
+				n = (const unsigned char *)hit - src + 1;
+			}
+			memcpy(buf + total, src, n);
+			mInHead += n;
+			total += n;
+			if (hit != 0) {
+				break;
+			}
+		// Scan the ring in place.
+		} else if (mAsync != 0) {
+			IoStatus status = mAsync->waitForInput(waitTime(), mCancel[0]);
+			if (status != IO_OK) {
+				if (status == IO_FAILURE) {
+					checkConnection();
+				}
+				read_failed(status);
+			}
+			const unsigned char *src;
+			unsigned long n = min(nBytes - total, mAsync->ring.readSpace(&src));
+			const void *hit = memchr(src, delimiter, n);
+			if (hit != 0) {
+				n = (const unsigned char *)hit - src + 1;
+			}
+			memcpy(buf + total, src, n);
+			mAsync->ring.commitRead(n);
+			mAsync->consumed();
+			mReceived += n;
+			total += n;
+			if (mStamping) {
+				collectStamps();
+			}
+			if (hit != 0) {
+				break;
+			}
+		// Without a buffer we mustn't read past the delimiter.
+		} else if (mInSize == 0) {
+			receiveAll(buf + total, 1);
+			if (buf[total++] == delimiter) {
+				break;
+			}
+		} else {
+			IoStatus status = fillInput(waitTime());
+			if (status != IO_OK) {
+				read_failed(status);
+			}
+		}
+	}
+	return total;
+}
+
+IoStatus PosixSerial::fillInput(int ms)
+{
+	// Remarks: only called once the buffer has been drained.
+	mInHead = mInTail = 0;
+	return receive(&mInBuf[0], mInSize, ms, mInTail);
+}
+
+IoStatus PosixSerial::receive(unsigned char *buf, unsigned long nBytes, int ms, unsigned long& n)
+{
+	n = 0;
+	if (mAsync != 0) {
+		IoStatus status = mAsync->waitForInput(ms, mCancel[0]);
+		if (status == IO_OK) {
+			n = mAsync->ring.read(buf, nBytes);
+			mAsync->consumed();
+			mReceived += n;
+			if (mStamping) {
+				collectStamps();
+			}
+		} else if (status == IO_FAILURE) {
+			// Remarks: the ring is empty, so stopping the reader doesn't touch the buffer.
+			checkConnection();
+		}
+		return status;
+	}
+	size_t r;
+	IoStatus status = read_some(mDevFD, buf, nBytes, ms, mCancel[0], r, mCounters->input);
+	if (mStamping && r > 0) {
+		stamp(mReceived, MonotonicTimer::now());
+	}
+	n = r;
+	mReceived += r;
+	if (status == IO_FAILURE) {
+		checkConnection();
+	}
+	return status;
+}
+
+void PosixSerial::receiveAll(unsigned char *buf, unsigned long nBytes)
+{
+	while (nBytes > 0) {
+		// Remarks: the timeout restarts with every bit of progress.
+		unsigned long n;
+		IoStatus status = receive(buf, nBytes, waitTime(), n);
+		if (status != IO_OK) {
+			read_failed(status);
+		}
+		buf += n;
+		nBytes -= n;
+	}
+}
+
+IoResult PosixSerial::readSome(unsigned char *buf, unsigned long nBytes, int ms)
+{
+	if (buf == 0) {
+		throw NullPointer();
+	}
+	if (!mFunctional) {
+		connect();
+	}
+	IoResult r;
+	r.nBytes = 0;
+	r.status = IO_OK;
+	if (nBytes == 0) {
+		return r;
+	}
+	if (ms < 0) {
+		ms = waitTime();
+	}
+	WaitTimer wait(mCounters->input);
+	// Small requests are served from the buffer, which may have to be refilled first.
+	if (mInHead == mInTail && nBytes < mInSize && mAsync == 0) {
+		r.status = fillInput(ms);
+	}
+	if (mInHead < mInTail) {
+		r.nBytes = min(nBytes, mInTail - mInHead);
+		memcpy(buf, &mInBuf[mInHead], r.nBytes);
+		mInHead += r.nBytes;
+	} else if (r.status == IO_OK) {
+		r.status = receive(buf, nBytes, ms, r.nBytes);
+	}
+	return r;
+}
+
+IoResult PosixSerial::writeSome(const unsigned char *buf, unsigned long nBytes, int ms)
+{
+	if (buf == 0) {
+		throw NullPointer();
+	}
+	if (!mFunctional) {
+		connect();
+	}
+	IoResult r;
+	r.nBytes = 0;
+	r.status = IO_OK;
+	if (ms < 0) {
+		ms = waitTime();
+	}
+	WaitTimer wait(mCounters->output);
+	// The pending output has to go first when the new output doesn't fit behind it; whatever
+	// else the device takes right away comes straight from the caller's buffer.
+	if (mOutTail + nBytes > mOutSize) {
+		struct iovec iov[2];
+		iov[0].iov_base = mOutTail > 0 ? &mOutBuf[0] : 0;
+		iov[0].iov_len = mOutTail;
+		iov[1].iov_base = const_cast<unsigned char *>(buf);
+		iov[1].iov_len = nBytes;
+		size_t n;
+		r.status = writev_some(mDevFD, iov, 2, ms, mCancel[0], n, mCounters->output);
+		unsigned long pending = min((unsigned long)n, mOutTail);
+		if (pending < mOutTail) {
+			memmove(&mOutBuf[0], &mOutBuf[pending], mOutTail - pending);
+		}
+		mOutTail -= pending;
+		r.nBytes = n - pending;
+		if (r.status == IO_FAILURE) {
+			checkConnection();
+		}
+	}
+	// Whatever fits into the buffer is held back, and counts as written.
+	unsigned long n = min(nBytes - r.nBytes, mOutSize - mOutTail);
+	if (r.status == IO_OK && n > 0) {
+		memcpy(&mOutBuf[mOutTail], buf + r.nBytes, n);
+		mOutTail += n;
+		r.nBytes += n;
+	}
+	return r;
+}
+
+int PosixSerial::waitTime() const
+{
+	return mTimeOut > 0 ? (int)mTimeOut : -1;
 }
 
 void PosixSerial::flushOutput()
@@ -217,6 +1295,7 @@ void PosixSerial::flushOutput()
 	if (!mFunctional) {
 		connect();
 	}
+	mOutTail = 0;
 	if (tcflush(mDevFD, TCOFLUSH) < 0) {
 		__dbg(string("PosixSerial: failed to flush output: ") + string(strerror(errno)));
 	}
@@ -227,6 +1306,16 @@ void PosixSerial::flushInput()
 	if (!mFunctional) {
 		connect();
 	}
+	mInHead = mInTail = 0;
+	if (mAsync != 0) {
+		unsigned long n = mAsync->ring.readable();
+		mAsync->ring.commitRead(n);
+		mAsync->consumed();
+		mReceived += n;
+		if (mStamping) {
+			collectStamps();
+		}
+	}
 	if (tcflush(mDevFD, TCIFLUSH) < 0) {
 		__dbg(string("PosixSerial: failed to flush input: ") + string(strerror(errno)));
 	}
@@ -239,3 +1328,218 @@ void PosixSerial::timeout(unsigned int ms)
 	}
 	mTimeOut = ms;
 }
+
+void PosixSerial::inputBuffer(unsigned long nBytes)
+{
+	// Hold on to any input that is still buffered.
+	unsigned long pending = mInTail - mInHead;
+	vector<unsigned char> buf(max(nBytes, pending));
+	if (pending > 0) {
+		memcpy(&buf[0], &mInBuf[mInHead], pending);
+	}
+	mInBuf.swap(buf);
+	mInSize = nBytes;
+	mInHead = 0;
+	mInTail = pending;
+	mConfig.inputBuffer = nBytes;
+}
+
+void PosixSerial::outputBuffer(unsigned long nBytes)
+{
+	// Make room for any output that is still being held back.
+	if (mOutTail > nBytes) {
+		commitOutput();
+	}
+	mOutBuf.resize(max(nBytes, mOutTail));
+	mOutSize = nBytes;
+	mConfig.outputBuffer = nBytes;
+}
+
+void PosixSerial::asyncInput(bool flag, unsigned long nBytes)
+{
+	if (!mFunctional) {
+		connect();
+	}
+	if (flag && mAsync == 0) {
+		mAsync = new AsyncInput(mDevFD, nBytes, mCounters->input, mReceived, mStamping);
+	} else if (!flag && mAsync != 0) {
+		AsyncInput *async = mAsync;
+		mAsync = 0;
+		async->stop();
+		// Hold on to whatever input the reader has already taken from the device.
+		try {
+			unsigned long buffered = mInTail - mInHead;
+			unsigned long pending = async->ring.readable();
+			if (pending > 0) {
+				vector<unsigned char> buf(max(mInSize, buffered + pending));
+				if (buffered > 0) {
+					memcpy(&buf[0], &mInBuf[mInHead], buffered);
+				}
+				async->ring.read(&buf[buffered], pending);
+				mReceived += pending;
+				mInBuf.swap(buf);
+				mInHead = 0;
+				mInTail = buffered + pending;
+			}
+		} catch (...) {
+			delete async;
+			throw;
+		}
+		// Remarks: the reader has stopped, so these are the last of its timestamps.
+		Stamp s;
+		while (async->nextStamp(s)) {
+			stamp(s.position, s.time);
+		}
+		delete async;
+	}
+}
+
+unsigned long PosixSerial::available()
+{
+	if (!mFunctional) {
+		connect();
+	}
+	unsigned long n = mInTail - mInHead;
+	if (mAsync != 0) {
+		n += mAsync->ring.readable();
+	} else {
+		int pending = 0;
+		if (ioctl(mDevFD, FIONREAD, &pending) == 0 && pending > 0) {
+			n += pending;
+		}
+	}
+	return n;
+}
+
+unsigned long PosixSerial::getAvailable(unsigned char *buf, unsigned long nBytes)
+{
+	if (buf == 0) {
+		throw NullPointer();
+	}
+	if (!mFunctional) {
+		connect();
+	}
+	// Hand out whatever is already buffered.
+	unsigned long total = min(nBytes, mInTail - mInHead);
+	if (total > 0) {
+		memcpy(buf, &mInBuf[mInHead], total);
+		mInHead += total;
+	}
+	if (total < nBytes) {
+		if (mAsync != 0) {
+			unsigned long n = mAsync->ring.read(buf + total, nBytes - total);
+			mAsync->consumed();
+			mReceived += n;
+			total += n;
+			if (mStamping) {
+				collectStamps();
+			}
+		} else {
+			ssize_t r = read(mDevFD, buf + total, nBytes - total);
+			count_syscall(mCounters->input, r);
+			if (r > 0) {
+				if (mStamping) {
+					stamp(mReceived, MonotonicTimer::now());
+				}
+				mReceived += r;
+				total += r;
+			} else if (r < 0 && errno != EINTR && errno != EAGAIN) {
+				__dbg(string("PosixSerial: failed to read: ") + string(strerror(errno)));
+				checkConnection();
+				throw ReadFailure();
+			}
+		}
+	}
+	return total;
+}
+
+PosixSerial::Metrics PosixSerial::metrics() const
+{
+	Metrics m;
+	const ChannelCounters *live[2] = { &mCounters->input, &mCounters->output };
+	Metrics::Channel *snap[2] = { &m.input, &m.output };
+	for (int i = 0; i < 2; ++i) {
+		snap[i]->bytes = live[i]->bytes.load(memory_order_relaxed);
+		snap[i]->syscalls = live[i]->syscalls.load(memory_order_relaxed);
+		snap[i]->wouldBlock = live[i]->wouldBlock.load(memory_order_relaxed);
+		snap[i]->interrupted = live[i]->interrupted.load(memory_order_relaxed);
+		snap[i]->timeouts = live[i]->timeouts.load(memory_order_relaxed);
+		for (int k = 0; k < Metrics::HISTOGRAM_SIZE; ++k) {
+			snap[i]->waits[k] = live[i]->waits[k].load(memory_order_relaxed);
+		}
+	}
+	unsigned long long connections = mCounters->connections.load(memory_order_relaxed);
+	m.reconnects = connections > 0 ? connections - 1 : 0;
+	return m;
+}
+
+void PosixSerial::timestamps(bool flag)
+{
+	if (!mFunctional) {
+		connect();
+	}
+	mStamping = flag;
+	if (mAsync != 0) {
+		mAsync->stamping = flag;
+	}
+	if (!flag) {
+		collectStamps();
+		mStamps.clear();
+	}
+}
+
+IoResult PosixSerial::readStamped(unsigned char *buf, unsigned long nBytes, long long& arrival,
+                                  int ms)
+{
+	// Remarks: where the first byte that's handed out stands in the input is known before it has
+	// even been read.
+	unsigned long long position = mReceived - (mInTail - mInHead);
+	IoResult r = readSome(buf, nBytes, ms);
+	arrival = 0;
+	if (r.nBytes > 0) {
+		collectStamps();
+		// The byte belongs to the last chunk that starts at or before it.
+		while (mStamps.size() > 1 && mStamps[1].position <= position) {
+			mStamps.pop_front();
+		}
+		if (!mStamps.empty() && mStamps.front().position <= position) {
+			arrival = mStamps.front().time;
+		}
+	}
+	return r;
+}
+
+void PosixSerial::stamp(unsigned long long position, long long time)
+{
+	// Let go of the timestamps of chunks that have been handed out completely, once there's a
+	// pile of them (which is only the case when readStamped() isn't called).
+	// Remarks: the chunks that the current read has just taken mustn't go yet.
+	if (mStamps.size() >= STAMPS) {
+		unsigned long long next = mReceived - (mInTail - mInHead);
+		while (mStamps.size() > 1 && mStamps[1].position <= next) {
+			mStamps.pop_front();
+		}
+	}
+	Stamp s;
+	s.position = position;
+	s.time = time;
+	mStamps.push_back(s);
+}
+
+void PosixSerial::collectStamps()
+{
+	Stamp s;
+	while (mAsync != 0 && mAsync->nextStamp(s)) {
+		stamp(s.position, s.time);
+	}
+}
+
+void PosixSerial::cancel()
+{
+	wake(mCancel[1]);
+}
+
+int PosixSerial::descriptor() const
+{
+	return mDevFD;
+}
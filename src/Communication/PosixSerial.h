@@ -14,7 +14,10 @@
 /************************************************************************/
 
 #include "Serial.h"
+#include "SerialConfig.h"
 #include <string>
+#include <vector>
+#include <deque>
 #include <termios.h> // needed for baud rate
 
 namespace metrobotics
@@ -30,19 +33,37 @@ namespace metrobotics
 	class PosixSerial : public Serial
 	{
 		public:
+			/**
+			 * \brief   Open a port at the given baud rate (see SerialConfig::baudRate).
+			 */
 			PosixSerial(const char *devName, unsigned int baudRate);
+
+			/**
+			 * \brief   Open a port with the given configuration.
+			 * \exception InvalidConfiguration is thrown when the configuration makes no sense
+			 */
+			PosixSerial(const char *devName, const SerialConfig& config);
 			~PosixSerial();
 
+			// [Exceptions.]
+			class InvalidConfiguration {};
+			class Cancelled {};
+
 			// [Implement input capabilities.]
 			void flushInput();
 			unsigned char getByte();
 			void getBlock(unsigned char *buf, unsigned long nBytes);
-
+			unsigned long getDelimited(unsigned char *buf, unsigned long nBytes,
+			                           unsigned char delimiter);
+			IoResult readSome(unsigned char *buf, unsigned long nBytes, int ms = -1);
 
 			// [Implement output capabilities.]
 			void flushOutput();
 			void putByte(const unsigned char);
 			void putBlock(const unsigned char *buf, unsigned long nBytes);
+			void putBlocks(const DataBlock *blocks, unsigned long nBlocks);
+			void commitOutput();
+			IoResult writeSome(const unsigned char *buf, unsigned long nBytes, int ms = -1);
 
 			// [Class-specific capabailites.]
 
@@ -51,12 +72,167 @@ namespace metrobotics
 			 */
 			static void debugging(bool);
 
+			/**
+			 * \brief   Reconfigure the port.
+			 * \details The new line settings take effect once all pending output has been
+			 *          transmitted; the buffer sizes are changed as if by inputBuffer() and
+			 *          outputBuffer().
+			 * \exception InvalidConfiguration is thrown when the configuration makes no sense
+			 *            (in which case the port is left as it was)
+			 */
+			void configure(const SerialConfig& config);
+
+			/**
+			 * \brief   The port's current configuration.
+			 */
+			const SerialConfig& configuration() const;
+
+			/**
+			 * \brief   The baud rate that the device actually runs at.
+			 * \details Drivers can only approximate some rates (depending on their clock
+			 *          dividers), and they report the rate that they settled for, which is what
+			 *          is returned here (in bits per second); 0 means that it can't be told.
+			 */
+			unsigned int baudRate() const;
+
 			/**
 			 * \brief   Set a timeout (in milliseconds) for all I/O operations.
 			 * \details A timeout of 0 (the default) may block I/O indefinitely.
 			 */
 			void timeout(unsigned int ms = 0);
 
+			/**
+			 * \brief   Set the size (in bytes) of the internal input buffer.
+			 * \details Input is then read from the device in chunks of up to this size and
+			 *          handed out from memory, which spares getByte() and getLine() a system
+			 *          call per byte; requests that are at least as large as the buffer still
+			 *          go straight to the device. A size of 0 (the default) disables buffering
+			 *          altogether, so that no more input is consumed from the device than was
+			 *          asked for.
+			 */
+			void inputBuffer(unsigned long nBytes = 0);
+
+			/**
+			 * \brief   Set the size (in bytes) of the internal output buffer.
+			 * \details Output is then held back in memory until it either overflows the buffer
+			 *          or is committed by commitOutput(), so that a message assembled from many
+			 *          putByte() and putBlock() calls costs a single system call. A size of 0
+			 *          (the default) disables buffering, so that all output goes straight to the
+			 *          device. Pending output is committed when the port is destroyed.
+			 */
+			void outputBuffer(unsigned long nBytes = 0);
+
+			/**
+			 * \brief   Toggle asynchronous input.
+			 * \details With asynchronous input, a dedicated thread continuously drains the
+			 *          device into a lock-free ring buffer of (at least) the given size, and all
+			 *          input is served from that ring instead; getBlock() and friends then only
+			 *          block, for up to timeout(), when the ring runs dry, while available() and
+			 *          getAvailable() never block at all. Input that is still in the ring when
+			 *          asynchronous input is turned off is kept in the input buffer. Turning it
+			 *          on again while it's already on has no effect (not even on the size).
+			 */
+			void asyncInput(bool flag, unsigned long nBytes = 65536);
+
+			/**
+			 * \brief   The number of bytes of input that can be had without blocking.
+			 */
+			unsigned long available();
+
+			/**
+			 * \brief   Get whatever input is available, without blocking.
+			 * \returns the number of bytes stored into \c buf, which may be 0
+			 */
+			unsigned long getAvailable(unsigned char *buf, unsigned long nBytes);
+
+			/**
+			 * \brief   Toggle receive timestamps.
+			 * \details With timestamps, the port notes the time at which each chunk of input is
+			 *          taken from the device, right as the read() that takes it returns (on
+			 *          whichever thread does the reading, see asyncInput()). readStamped() then
+			 *          tells when the input that it hands out arrived, no matter how long it has
+			 *          since waited in buffers or for the caller to be scheduled. With
+			 *          asynchronous input, the reader takes input as soon as it arrives; without
+			 *          it, input waits in the driver until it's asked for, and the time tells when
+			 *          that was. Timestamps are off by default; input that is taken while they're
+			 *          off has no time, and neither has input that the reader takes while the
+			 *          consumer is more than 1024 chunks behind it.
+			 */
+			void timestamps(bool flag);
+
+			/**
+			 * \brief   Get whatever input arrives first (see readSome()), along with the time at
+			 *          which it arrived.
+			 * \details \c arrival is set to the time (in nanoseconds on the monotonic clock) at
+			 *          which the first byte that is stored into \c buf was taken from the
+			 *          device, or to 0 if that time isn't known. The rest of the bytes arrived
+			 *          with it or after it.
+			 */
+			IoResult readStamped(unsigned char *buf, unsigned long nBytes, long long& arrival,
+			                     int ms = -1);
+
+			/**
+			 * \brief   Cancel a blocked read or write.
+			 * \details Meant to be called from another thread: whatever read or write is
+			 *          waiting for the device is woken up, and gives up with Cancelled (or
+			 *          IO_CANCELLED, for readSome() and writeSome()); whatever it has
+			 *          transferred so far stays transferred. If nothing is waiting, then the
+			 *          next wait is cancelled instead, so a cancellation is never lost to a
+			 *          race with the call that it's meant for.
+			 */
+			void cancel();
+
+			/**
+			 * \brief   A snapshot of a port's I/O metrics (see metrics()).
+			 */
+			struct Metrics
+			{
+				enum { HISTOGRAM_SIZE = 32 };
+
+				// The traffic in one direction.
+				struct Channel
+				{
+					unsigned long long bytes;       // transferred to or from the device
+					unsigned long long syscalls;    // reads or writes issued to the device
+					unsigned long long wouldBlock;  // reads or writes that came back empty (EAGAIN)
+					unsigned long long interrupted; // calls (including waits) cut short by EINTR
+					unsigned long long timeouts;    // waits that ran out of time
+
+					// Remarks: waits[i] counts the transfers (getBlock(), putBlock() and the
+					// like) that had to wait for the device, and were blocked for a total of
+					// 2^i to 2^(i+1) microseconds; waits[0] also counts shorter waits, and the
+					// last bucket longer ones. Transfers that never had to wait aren't counted.
+					unsigned long long waits[HISTOGRAM_SIZE];
+				};
+
+				Channel input;
+				Channel output;
+
+				// Remarks: a port whose device goes away (it's unplugged, or hangs up) closes
+				// it as soon as an I/O fails on that account, and opens it again with the next
+				// I/O; this counts how many times it has done so.
+				unsigned long long reconnects;
+			};
+
+			/**
+			 * \brief   Take a snapshot of the port's I/O metrics.
+			 * \details The metrics are counted from the moment the port is opened. Counting is
+			 *          always on, and costs next to nothing: a few plain stores per system call,
+			 *          plus a pair of clock readings around each wait (which is when there's
+			 *          time to spare anyway). Snapshots may be taken from any thread; each
+			 *          counter is read atomically, but the snapshot as a whole is not (so, e.g.,
+			 *          bytes and syscalls may be off by one transfer).
+			 */
+			Metrics metrics() const;
+
+			/**
+			 * \brief   The POSIX file descriptor of the device.
+			 * \details Meant for waiting on the device alongside others (e.g. with a Reactor);
+			 *          all actual I/O should still go through this object. The descriptor
+			 *          changes when the port reconnects (see Metrics::reconnects).
+			 */
+			int descriptor() const;
+
 
 		private:
 			// Disable copying and assignment for PosixSerial objects.
@@ -66,12 +242,72 @@ namespace metrobotics
 			// Establish (or re-establish) a connection.
 			void connect();
 
+			// After a failed I/O: if the device has gone away, close it (keeping whatever input
+			// has already been taken from it), so that the next I/O reconnects.
+			void checkConnection();
+
+			// Apply the line and driver settings to the device.
+			void setAttributes(const SerialConfig& config, int when);
+
+			// Refill the (empty) input buffer from the device, waiting for up to ms milliseconds.
+			IoStatus fillInput(int ms);
+
+			// Get at least one byte (and no more than nBytes) from the device or the ring,
+			// waiting for up to ms milliseconds (or indefinitely if ms is negative).
+			IoStatus receive(unsigned char *buf, unsigned long nBytes, int ms, unsigned long& n);
+
+			// Get exactly nBytes from the device or the ring.
+			void receiveAll(unsigned char *buf, unsigned long nBytes);
+
+			// The timeout in the form that the waiting functions expect (negative for forever).
+			int waitTime() const;
+
+			// Note the arrival of the chunk of input that starts at the given position.
+			void stamp(unsigned long long position, long long time);
+
+			// Take over the timestamps that the reader of asynchronous input has noted.
+			void collectStamps();
+
 			// Internal state members.
 			bool mFunctional;
 			std::string mDevName;
 			int mDevFD; // Posix file descriptor corresponding to the serial device
-			unsigned int mLineSpeed; // Baud rate
+			SerialConfig mConfig;
 			unsigned int mTimeOut; // in milliseconds
+
+			// Input buffer: bytes [mInHead, mInTail) of mInBuf are yet to be handed out.
+			std::vector<unsigned char> mInBuf;
+			unsigned long mInSize; // 0 means pass-through
+			unsigned long mInHead;
+			unsigned long mInTail;
+
+			// Output buffer: bytes [0, mOutTail) of mOutBuf are yet to be written.
+			std::vector<unsigned char> mOutBuf;
+			unsigned long mOutSize; // 0 means pass-through
+			unsigned long mOutTail;
+
+			// Input timestamps: where each chunk of input starts (counting every byte that has
+			// been taken from the device or the ring), and when it arrived.
+			struct Stamp
+			{
+				unsigned long long position;
+				long long time; // in nanoseconds
+			};
+			bool mStamping;
+			std::deque<Stamp> mStamps;
+			unsigned long long mReceived; // the position of the next byte to be taken
+
+			// Asynchronous input (or null when input is synchronous).
+			struct AsyncInput;
+			AsyncInput *mAsync;
+			unsigned long mAsyncSize; // the ring to restore when reconnecting (0 for none)
+
+			// Live I/O metrics.
+			struct Counters;
+			Counters *mCounters;
+
+			// Pipe that wakes up (and cancels) blocked reads and writes.
+			int mCancel[2];
 	};
 
 }
@@ -0,0 +1,188 @@
+#include "Reactor.h"
+using namespace metrobotics;
+
+#include <cstring>
+#include <cerrno>
+using namespace std;
+
+#include <unistd.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+// The maximum number of events to collect per wait.
+static const int MAX_EVENTS = 64;
+
+// The amount of input to read from a port at a time.
+static const unsigned long CHUNK_SIZE = 4096;
+
+Reactor::Reactor()
+:mPollFD(-1),
+ mWakeFD(-1),
+ mStopped(false)
+{
+	if ((mPollFD = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+		throw ReactorFailure();
+	}
+	if ((mWakeFD = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) {
+		close(mPollFD);
+		throw ReactorFailure();
+	}
+	// Remarks: the wake-up descriptor is the only one that's registered with a null pointer.
+	struct epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.ptr = 0;
+	if (epoll_ctl(mPollFD, EPOLL_CTL_ADD, mWakeFD, &ev) < 0) {
+		close(mWakeFD);
+		close(mPollFD);
+		throw ReactorFailure();
+	}
+}
+
+Reactor::~Reactor()
+{
+	for (map<int, Entry *>::iterator i = mEntries.begin(); i != mEntries.end(); ++i) {
+		delete i->second;
+	}
+	for (vector<Entry *>::iterator i = mGarbage.begin(); i != mGarbage.end(); ++i) {
+		delete *i;
+	}
+	close(mWakeFD);
+	close(mPollFD);
+}
+
+void Reactor::add(int fd, Handler& handler, unsigned int events)
+{
+	Entry *entry = new Entry;
+	entry->fd = fd;
+	entry->handler = &handler;
+	entry->port = 0;
+	entry->dataHandler = 0;
+	entry->removed = false;
+	insert(entry, events);
+}
+
+void Reactor::add(PosixSerial& port, DataHandler& handler)
+{
+	Entry *entry = new Entry;
+	entry->fd = port.descriptor();
+	entry->handler = 0;
+	entry->port = &port;
+	entry->dataHandler = &handler;
+	entry->removed = false;
+	insert(entry, EPOLLIN);
+}
+
+void Reactor::insert(Entry *entry, unsigned int events)
+{
+	// Replace any previous registration of the same descriptor.
+	remove(entry->fd);
+	struct epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = events;
+	ev.data.ptr = entry;
+	if (epoll_ctl(mPollFD, EPOLL_CTL_ADD, entry->fd, &ev) < 0) {
+		delete entry;
+		throw ReactorFailure();
+	}
+	mEntries[entry->fd] = entry;
+}
+
+void Reactor::remove(int fd)
+{
+	map<int, Entry *>::iterator i = mEntries.find(fd);
+	if (i != mEntries.end()) {
+		epoll_ctl(mPollFD, EPOLL_CTL_DEL, fd, 0);
+		// Remarks: events for this entry may still be pending in the current batch, so it can't
+		// be deleted until the batch is over.
+		i->second->removed = true;
+		mGarbage.push_back(i->second);
+		mEntries.erase(i);
+	}
+}
+
+void Reactor::remove(PosixSerial& port)
+{
+	remove(port.descriptor());
+}
+
+unsigned long Reactor::size() const
+{
+	return mEntries.size();
+}
+
+unsigned int Reactor::poll(int ms)
+{
+	struct epoll_event events[MAX_EVENTS];
+	int n = epoll_wait(mPollFD, events, MAX_EVENTS, ms);
+	if (n < 0) {
+		if (errno == EINTR) {
+			return 0;
+		}
+		throw ReactorFailure();
+	}
+	unsigned int dispatched = 0;
+	for (int i = 0; i < n; ++i) {
+		Entry *entry = static_cast<Entry *>(events[i].data.ptr);
+		if (entry == 0) {
+			// Somebody wants us to stop; consume the wake-up.
+			uint64_t count;
+			while (read(mWakeFD, &count, sizeof(count)) < 0 && errno == EINTR);
+		} else if (!entry->removed) {
+			if (entry->handler != 0) {
+				entry->handler->ready(entry->fd, events[i].events);
+			} else {
+				dispatch(entry, events[i].events);
+			}
+			++dispatched;
+		}
+	}
+	for (vector<Entry *>::iterator i = mGarbage.begin(); i != mGarbage.end(); ++i) {
+		delete *i;
+	}
+	mGarbage.clear();
+	return dispatched;
+}
+
+void Reactor::dispatch(Entry *entry, unsigned int events)
+{
+	PosixSerial& port = *entry->port;
+	DataHandler& handler = *entry->dataHandler;
+	unsigned char buf[CHUNK_SIZE];
+	unsigned long n;
+	try {
+		// Drain the port; a short read means that there's nothing left.
+		n = port.getAvailable(buf, sizeof(buf));
+		if (n == 0 && (events & (EPOLLHUP | EPOLLERR))) {
+			// Remarks: a hang-up without any pending data would otherwise wake us up forever.
+			throw Serial::ReadFailure();
+		}
+		while (n > 0) {
+			handler.received(port, buf, n);
+			if (n < sizeof(buf) || entry->removed) {
+				break;
+			}
+			n = port.getAvailable(buf, sizeof(buf));
+		}
+	} catch (Serial::ReadFailure&) {
+		remove(port);
+		handler.failed(port);
+	}
+}
+
+void Reactor::run()
+{
+	while (!mStopped) {
+		poll();
+	}
+	// Remarks: a stop() that comes before run() still counts.
+	mStopped = false;
+}
+
+void Reactor::stop()
+{
+	mStopped = true;
+	const uint64_t one = 1;
+	while (write(mWakeFD, &one, sizeof(one)) < 0 && errno == EINTR);
+}
@@ -0,0 +1,165 @@
+#ifndef METROBOTICS_REACTOR_H
+#define METROBOTICS_REACTOR_H
+
+#include "PosixSerial.h"
+#include <map>
+#include <atomic>
+#include <vector>
+#include <sys/epoll.h>
+
+namespace metrobotics
+{
+	/**
+	 * \class   Reactor
+	 *
+	 * \brief   A single-threaded event loop that waits on many devices at once.
+	 *
+	 * \details Instead of dedicating a thread (blocked in getBlock()) to every device, register
+	 *          the devices with a reactor and let one thread wait on all of them with Linux's
+	 *          epoll facility. A PosixSerial port may be registered with a DataHandler, in which
+	 *          case the reactor reads whatever input has arrived and hands it over; any other
+	 *          file descriptor may be registered with a Handler, which is merely told that the
+	 *          descriptor is ready. Either way, the cost of the loop depends on how much traffic
+	 *          there is rather than on how many devices there are.
+	 *
+	 * \warning Registered ports must not use asynchronous input (see PosixSerial::asyncInput()),
+	 *          since their input would then never reach the reactor. Registration and dispatch
+	 *          must happen on the same thread; only stop() may be called from other threads.
+	 */
+	class Reactor
+	{
+		public:
+			/**
+			 * \brief   Receives readiness notifications for a file descriptor.
+			 */
+			class Handler
+			{
+				public:
+					virtual ~Handler() {}
+
+					/**
+					 * \brief   The descriptor is ready.
+					 *
+					 * \arg     fd is the descriptor that is ready
+					 * \arg     events is the set of epoll events (e.g. \c EPOLLIN, \c EPOLLHUP)
+					 *          that occurred
+					 */
+					virtual void ready(int fd, unsigned int events) = 0;
+			};
+
+			/**
+			 * \brief   Receives input from a serial port.
+			 */
+			class DataHandler
+			{
+				public:
+					virtual ~DataHandler() {}
+
+					/**
+					 * \brief   New input has arrived on the port.
+					 *
+					 * \details The input is only valid for the duration of the call.
+					 */
+					virtual void received(PosixSerial& port, const unsigned char *buf,
+					                      unsigned long nBytes) = 0;
+
+					/**
+					 * \brief   The port has failed; it has already been removed from the
+					 *          reactor by the time this is called.
+					 */
+					virtual void failed(PosixSerial& port) {}
+			};
+
+			// [Exceptions.]
+			class ReactorFailure {};
+
+			/**
+			 * \brief   Construct a reactor with nothing registered.
+			 */
+			Reactor();
+
+			/**
+			 * \brief   Destructor.
+			 */
+			~Reactor();
+
+			/**
+			 * \brief   Register a file descriptor.
+			 *
+			 * \arg     events is the set of epoll events to wait for
+			 */
+			void add(int fd, Handler& handler, unsigned int events = EPOLLIN);
+
+			/**
+			 * \brief   Register a serial port whose input is to be handed to the given handler.
+			 */
+			void add(PosixSerial& port, DataHandler& handler);
+
+			/**
+			 * \brief   Unregister a file descriptor; unknown descriptors are ignored.
+			 */
+			void remove(int fd);
+
+			/**
+			 * \brief   Unregister a serial port; unknown ports are ignored.
+			 */
+			void remove(PosixSerial& port);
+
+			/**
+			 * \brief   The number of registered descriptors and ports.
+			 */
+			unsigned long size() const;
+
+			/**
+			 * \brief   Wait for events once and dispatch them.
+			 *
+			 * \arg     ms is the maximum time (in milliseconds) to wait; a negative value waits
+			 *          indefinitely and 0 doesn't wait at all
+			 *
+			 * \returns the number of descriptors and ports that were dispatched
+			 */
+			unsigned int poll(int ms = -1);
+
+			/**
+			 * \brief   Keep waiting for and dispatching events until stop() is called.
+			 */
+			void run();
+
+			/**
+			 * \brief   Make run() (or a pending poll()) return as soon as possible.
+			 *
+			 * \details Safe to call from any thread, including from within a handler.
+			 */
+			void stop();
+
+		private:
+			// Disable copying and assignment for Reactor objects.
+			Reactor(const Reactor&);
+			Reactor& operator=(const Reactor&);
+
+			// A single registration.
+			struct Entry
+			{
+				int fd;
+				Handler *handler;
+				PosixSerial *port;
+				DataHandler *dataHandler;
+				bool removed;
+			};
+
+			// Register an entry with epoll.
+			void insert(Entry *entry, unsigned int events);
+
+			// Hand a port's pending input over to its data handler.
+			void dispatch(Entry *entry, unsigned int events);
+
+			// Internal state members.
+			int mPollFD; // epoll instance
+			int mWakeFD; // eventfd that interrupts the wait
+			std::atomic<bool> mStopped;
+			std::map<int, Entry *> mEntries;
+			std::vector<Entry *> mGarbage; // removed while dispatching
+	};
+}
+
+#endif
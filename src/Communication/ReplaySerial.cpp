@@ -0,0 +1,241 @@
+#include "ReplaySerial.h"
+#include "SerialRecorder.h"
+#include "Timer/MonotonicTimer.h"
+using namespace metrobotics;
+
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+using namespace std;
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Load an integer stored in little-endian byte order.
+static unsigned long long getLE(const unsigned char *buf, unsigned long nBytes)
+{
+	unsigned long long value = 0;
+	for (unsigned long i = 0; i < nBytes; ++i) {
+		value |= (unsigned long long)buf[i] << (8 * i);
+	}
+	return value;
+}
+
+ReplaySerial::ReplaySerial(const char *path, bool paced)
+:mMap(0),
+ mMapSize(0),
+ mPaced(paced),
+ mNext(SerialRecorder::HEADER_SIZE),
+ mHead(0),
+ mTail(0),
+ mFirstTime(0),
+ mStartTime(0)
+{
+	if (path == 0) {
+		throw NullPointer();
+	}
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		throw LogFailure();
+	}
+	struct stat st;
+	if (fstat(fd, &st) < 0 || st.st_size < (off_t)SerialRecorder::HEADER_SIZE) {
+		close(fd);
+		throw LogFailure();
+	}
+	mMapSize = st.st_size;
+	void *map = mmap(0, mMapSize, PROT_READ, MAP_PRIVATE, fd, 0);
+	// Remarks: the mapping outlives the descriptor.
+	close(fd);
+	if (map == MAP_FAILED) {
+		throw LogFailure();
+	}
+	mMap = static_cast<const unsigned char *>(map);
+	if (memcmp(mMap, "MUSR\x01", 5) != 0) {
+		munmap(map, mMapSize);
+		throw LogFailure();
+	}
+	// Playback is sequential.
+	madvise(map, mMapSize, MADV_SEQUENTIAL);
+	if (mMapSize >= SerialRecorder::HEADER_SIZE + SerialRecorder::CHUNK_HEADER_SIZE) {
+		mFirstTime = getLE(mMap + SerialRecorder::HEADER_SIZE, 8);
+	}
+	mStartTime = MonotonicTimer::now();
+}
+
+ReplaySerial::~ReplaySerial()
+{
+	munmap(const_cast<unsigned char *>(mMap), mMapSize);
+}
+
+bool ReplaySerial::advance()
+{
+	while (mHead == mTail) {
+		// Find the next chunk of input.
+		if (mNext + SerialRecorder::CHUNK_HEADER_SIZE > mMapSize) {
+			return false;
+		}
+		const unsigned char *header = mMap + mNext;
+		unsigned long long stamp = getLE(header, 8);
+		unsigned long word = getLE(header + 8, 4);
+		unsigned long length = word >> 1;
+		mNext += SerialRecorder::CHUNK_HEADER_SIZE;
+		// Remarks: a chunk that was cut short (e.g. by a crash) still counts, up to the end.
+		length = min(length, mMapSize - mNext);
+		const unsigned char *data = mMap + mNext;
+		mNext += length;
+		// Remarks: time stamps of different sessions are unrelated, so playback of each session
+		// is timed from its marker, right after the previous session has been played back.
+		if (word == 0) {
+			mFirstTime = stamp;
+			mStartTime = MonotonicTimer::now();
+			continue;
+		}
+		if ((word & 1) != SerialRecorder::INPUT) {
+			continue;
+		}
+		// Hold the chunk back until its time has come.
+		if (mPaced) {
+			long long due = mStartTime + ((long long)stamp - mFirstTime);
+			struct timespec ts;
+			ts.tv_sec = due / 1000000000LL;
+			ts.tv_nsec = due % 1000000000LL;
+			while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, 0) == EINTR);
+		}
+		mHead = data;
+		mTail = data + length;
+	}
+	return true;
+}
+
+bool ReplaySerial::eof() const
+{
+	if (mHead != mTail) {
+		return false;
+	}
+	// Look ahead (without waiting) for another chunk of input.
+	for (unsigned long next = mNext; next + SerialRecorder::CHUNK_HEADER_SIZE <= mMapSize; ) {
+		unsigned long word = getLE(mMap + next + 8, 4);
+		next += SerialRecorder::CHUNK_HEADER_SIZE;
+		if ((word & 1) == SerialRecorder::INPUT && (word >> 1) > 0 && next < mMapSize) {
+			return false;
+		}
+		next += word >> 1;
+	}
+	return true;
+}
+
+void ReplaySerial::rewind()
+{
+	mNext = SerialRecorder::HEADER_SIZE;
+	mHead = mTail = 0;
+	mStartTime = MonotonicTimer::now();
+}
+
+void ReplaySerial::flushInput()
+{
+	// Nothing is pending; recorded input arrives only when it's read.
+}
+
+unsigned char ReplaySerial::getByte()
+{
+	if (!advance()) {
+		throw ReadFailure();
+	}
+	return *mHead++;
+}
+
+void ReplaySerial::getBlock(unsigned char *buf, unsigned long nBytes)
+{
+	if (buf == 0) {
+		throw NullPointer();
+	}
+	while (nBytes > 0) {
+		if (!advance()) {
+			throw ReadFailure();
+		}
+		unsigned long n = min(nBytes, (unsigned long)(mTail - mHead));
+		memcpy(buf, mHead, n);
+		mHead += n;
+		buf += n;
+		nBytes -= n;
+	}
+}
+
+unsigned long ReplaySerial::getDelimited(unsigned char *buf, unsigned long nBytes,
+                                         unsigned char delimiter)
+{
+	if (buf == 0) {
+		throw NullPointer();
+	}
+	unsigned long total = 0;
+	while (total < nBytes) {
+		if (!advance()) {
+			throw ReadFailure();
+		}
+		unsigned long n = min(nBytes - total, (unsigned long)(mTail - mHead));
+		const void *hit = memchr(mHead, delimiter, n);
+		if (hit != 0) {
+			n = (const unsigned char *)hit - mHead + 1;
+		}
+		memcpy(buf + total, mHead, n);
+		mHead += n;
+		total += n;
+		if (hit != 0) {
+			break;
+		}
+	}
+	return total;
+}
+
+IoResult ReplaySerial::readSome(unsigned char *buf, unsigned long nBytes, int)
+{
+	if (buf == 0) {
+		throw NullPointer();
+	}
+	// Remarks: pacing waits for as long as the recording says, regardless of the timeout.
+	IoResult r;
+	r.nBytes = 0;
+	r.status = IO_OK;
+	if (nBytes > 0) {
+		if (!advance()) {
+			r.status = IO_FAILURE;
+		} else {
+			r.nBytes = min(nBytes, (unsigned long)(mTail - mHead));
+			memcpy(buf, mHead, r.nBytes);
+			mHead += r.nBytes;
+		}
+	}
+	return r;
+}
+
+void ReplaySerial::flushOutput()
+{
+	// Output is discarded anyway.
+}
+
+void ReplaySerial::putByte(const unsigned char)
+{
+	// Output is discarded.
+}
+
+void ReplaySerial::putBlock(const unsigned char *buf, unsigned long nBytes)
+{
+	if (buf == 0) {
+		throw NullPointer();
+	}
+}
+
+IoResult ReplaySerial::writeSome(const unsigned char *buf, unsigned long nBytes, int)
+{
+	if (buf == 0) {
+		throw NullPointer();
+	}
+	IoResult r;
+	r.nBytes = nBytes;
+	r.status = IO_OK;
+	return r;
+}
@@ -0,0 +1,84 @@
+#ifndef METROBOTICS_REPLAYSERIAL_H
+#define METROBOTICS_REPLAYSERIAL_H
+
+#include "Serial.h"
+
+namespace metrobotics
+{
+	/**
+	 * \class   ReplaySerial
+	 *
+	 * \brief   A Serial device that plays back the input recorded by a SerialRecorder.
+	 *
+	 * \details The log file is mapped into memory and its input chunks are served straight from
+	 *          there, either as fast as they can be consumed or paced to their original timing.
+	 *          Recorded output is skipped, and anything that's written to the device is simply
+	 *          discarded. Once the recorded input runs out, reads fail with ReadFailure.
+	 */
+	class ReplaySerial : public Serial
+	{
+		public:
+			// [Exceptions.]
+			class LogFailure {};
+
+			/**
+			 * \brief   Open a log for playback.
+			 *
+			 * \arg     path is the log file written by a SerialRecorder
+			 * \arg     paced determines whether each chunk of input is held back until as much
+			 *          time has passed since the start of playback as had passed since the
+			 *          start of the recording (or, in a log of several recording sessions,
+			 *          since the start of the session), or whether input is served as fast as
+			 *          possible
+			 *
+			 * \exception LogFailure is thrown when the file can't be mapped or isn't a log
+			 */
+			ReplaySerial(const char *path, bool paced = false);
+			~ReplaySerial();
+
+			// [Implement input capabilities.]
+			void flushInput();
+			unsigned char getByte();
+			void getBlock(unsigned char *buf, unsigned long nBytes);
+			unsigned long getDelimited(unsigned char *buf, unsigned long nBytes,
+			                           unsigned char delimiter);
+			IoResult readSome(unsigned char *buf, unsigned long nBytes, int ms = -1);
+
+			// [Implement output capabilities.]
+			void flushOutput();
+			void putByte(const unsigned char);
+			void putBlock(const unsigned char *buf, unsigned long nBytes);
+			IoResult writeSome(const unsigned char *buf, unsigned long nBytes, int ms = -1);
+
+			// [Class-specific capabilities.]
+			/**
+			 * \brief   Determine whether all of the recorded input has been played back.
+			 */
+			bool eof() const;
+
+			/**
+			 * \brief   Start playing back from the beginning (and restart the pacing clock).
+			 */
+			void rewind();
+
+		private:
+			// Disable copying and assignment for ReplaySerial objects.
+			ReplaySerial(const ReplaySerial&);
+			ReplaySerial& operator=(const ReplaySerial&);
+
+			// Make sure that the current chunk has input left; returns false at the end of the log.
+			bool advance();
+
+			// Internal state members.
+			const unsigned char *mMap;
+			unsigned long mMapSize;
+			bool mPaced;
+			unsigned long mNext;      // offset of the next chunk header
+			const unsigned char *mHead; // unread input of the current chunk
+			const unsigned char *mTail;
+			long long mFirstTime;     // time stamp of the session's first chunk, in nanoseconds
+			long long mStartTime;     // when playback of the session started, in nanoseconds
+	};
+}
+
+#endif
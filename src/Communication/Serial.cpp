@@ -23,9 +23,89 @@ void Serial::flush()
 	this->flushInput();
 }
 
+unsigned long DataSource::getDelimited(unsigned char *buf, unsigned long nBytes,
+                                       unsigned char delimiter)
+{
+	unsigned long n = 0;
+	while (n < nBytes && (buf[n++] = this->getByte()) != delimiter);
+	return n;
+}
+
+IoResult DataSource::readSome(unsigned char *buf, unsigned long nBytes, int)
+{
+	if (buf == 0) {
+		throw Serial::NullPointer();
+	}
+	IoResult r;
+	r.nBytes = 0;
+	r.status = IO_OK;
+	if (nBytes > 0) {
+		try {
+			buf[0] = this->getByte();
+			r.nBytes = 1;
+		} catch (Serial::ReadTimeout&) {
+			r.status = IO_TIMEOUT;
+		} catch (Serial::ReadFailure&) {
+			r.status = IO_FAILURE;
+		}
+	}
+	return r;
+}
+
+IoResult DataSink::writeSome(const unsigned char *buf, unsigned long nBytes, int)
+{
+	if (buf == 0) {
+		throw Serial::NullPointer();
+	}
+	IoResult r;
+	r.nBytes = 0;
+	r.status = IO_OK;
+	try {
+		this->putBlock(buf, nBytes);
+		r.nBytes = nBytes;
+	} catch (Serial::WriteTimeout&) {
+		r.status = IO_TIMEOUT;
+	} catch (Serial::WriteFailure&) {
+		r.status = IO_FAILURE;
+	}
+	return r;
+}
+
+void DataSink::putBlocks(const DataBlock *blocks, unsigned long nBlocks)
+{
+	if (blocks == 0) {
+		throw Serial::NullPointer();
+	}
+	for (unsigned long i = 0; i < nBlocks; ++i) {
+		this->putBlock(blocks[i].buf, blocks[i].nBytes);
+	}
+}
+
 string Serial::getLine(char delimiter)
 {
 	string ret;
-	for (int i = 0; (ret += this->getByte())[i] != delimiter; ++i);
+	getLine(ret, delimiter);
 	return ret;
 }
+
+void Serial::getLine(string& line, char delimiter)
+{
+	// Gather the line in chunks; appending doesn't allocate once the string is big enough.
+	unsigned char chunk[256];
+	unsigned long n;
+	line.clear();
+	do {
+		n = this->getDelimited(chunk, sizeof(chunk), delimiter);
+		line.append((const char *)chunk, n);
+	} while (n == 0 || chunk[n - 1] != (unsigned char)delimiter);
+}
+
+unsigned long Serial::getLine(char *buf, unsigned long size, bool& truncated, char delimiter)
+{
+	if (buf == 0) {
+		throw NullPointer();
+	}
+	unsigned long n = this->getDelimited((unsigned char *)buf, size, delimiter);
+	truncated = (n == 0 || buf[n - 1] != delimiter);
+	return n;
+}
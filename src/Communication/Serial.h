@@ -33,6 +33,29 @@ namespace metrobotics
 			int mId;
 	};
 
+	/**
+	 * \brief   Outcome of a non-throwing transfer
+	 * \details See DataSource::readSome() and DataSink::writeSome().
+	 */
+	enum IoStatus
+	{
+		IO_OK,       // some data was transferred
+		IO_TIMEOUT,  // nothing could be transferred in time
+		IO_FAILURE,  // the device has failed
+		IO_CANCELLED // the wait was cancelled from another thread
+	};
+
+	/**
+	 * \brief   Result of a non-throwing transfer
+	 * \details Reports how far a transfer got along with how it ended; a transfer that ended
+	 *          with IO_TIMEOUT or IO_FAILURE may still have moved some data.
+	 */
+	struct IoResult
+	{
+		unsigned long nBytes;
+		IoStatus status;
+	};
+
 	/**
 	 * \brief   Sequential input device (source of input)
 	 * \details A purely abstract class of objects that supply data.
@@ -45,6 +68,42 @@ namespace metrobotics
 			virtual ~DataSource() {}
 			virtual unsigned char getByte() = 0;
 			virtual void getBlock(unsigned char *buf, unsigned long nBytes) = 0;
+
+			/**
+			 * \brief   Get a block of input that ends with the first occurrence of the delimiter.
+			 * \details Reads up to and including the delimiter, but never more than \c nBytes;
+			 *          if the delimiter hasn't been found by then, the rest of the input is left
+			 *          for subsequent reads. The default implementation reads one byte at a
+			 *          time; implementations that buffer their input should scan it in bulk.
+			 * \returns the number of bytes stored into \c buf
+			 */
+			virtual unsigned long getDelimited(unsigned char *buf, unsigned long nBytes,
+			                                   unsigned char delimiter);
+
+			/**
+			 * \brief   Get whatever input arrives first, without throwing on timeouts.
+			 * \details Waits for up to \c ms milliseconds for any input, and then stores as much
+			 *          of it as is at hand (at least one byte, at most \c nBytes) into \c buf.
+			 *          A timeout of 0 doesn't wait at all, and a negative timeout (the default)
+			 *          waits as long as the source's own timeout allows. Unlike getBlock(),
+			 *          running out of time or into a failure is reported through the status,
+			 *          which makes this the call of choice for polling loops.
+			 *
+			 *          The default implementation can neither wait selectively nor tell what's at
+			 *          hand: it reads a single byte with getByte() and turns the ReadTimeout and
+			 *          ReadFailure exceptions of Serial into the corresponding status.
+			 */
+			virtual IoResult readSome(unsigned char *buf, unsigned long nBytes, int ms = -1);
+	};
+
+	/**
+	 * \brief   A contiguous block of output
+	 * \details Used to hand several separate blocks to DataSink::putBlocks() at once.
+	 */
+	struct DataBlock
+	{
+		const unsigned char *buf;
+		unsigned long nBytes;
 	};
 
 	/**
@@ -59,6 +118,36 @@ namespace metrobotics
 			virtual ~DataSink() {}
 			virtual void putByte(const unsigned char) = 0;
 			virtual void putBlock(const unsigned char *buf, unsigned long nBytes) = 0;
+
+			/**
+			 * \brief   Put several blocks of output, in order.
+			 * \details Equivalent to calling putBlock() for each block in turn, which is what
+			 *          the default implementation does; implementations may gather the blocks
+			 *          into a single write instead.
+			 */
+			virtual void putBlocks(const DataBlock *blocks, unsigned long nBlocks);
+
+			/**
+			 * \brief   Write out any output that is being held back.
+			 * \details Sinks that buffer their output only write it out once the buffer is full
+			 *          or once it is committed; the default implementation does nothing.
+			 */
+			virtual void commitOutput() {}
+
+			/**
+			 * \brief   Put as much output as can be taken, without throwing on timeouts.
+			 * \details Waits for up to \c ms milliseconds for the sink to take any output, and
+			 *          hands it as much of \c buf as it takes right away; output that is held
+			 *          back (see commitOutput()) counts as taken. A timeout of 0 doesn't wait at
+			 *          all, and a negative timeout (the default) waits as long as the sink's own
+			 *          timeout allows. Running out of time or into a failure is reported through
+			 *          the status rather than thrown.
+			 *
+			 *          The default implementation puts all of \c buf with putBlock(), and turns
+			 *          the WriteTimeout and WriteFailure exceptions of Serial into the
+			 *          corresponding status (in which case nothing counts as written).
+			 */
+			virtual IoResult writeSome(const unsigned char *buf, unsigned long nBytes, int ms = -1);
 	};
 
 	/**
@@ -108,6 +197,24 @@ namespace metrobotics
 			 *          part of the line.
 			 */
 			std::string getLine(char delimiter = '\n');
+
+			/**
+			 * \brief   Get a whole line of input into a reusable string.
+			 * \details Same as above, except that the line replaces the contents of \c line,
+			 *          whose storage is reused; once the string has grown to fit the longest
+			 *          line, no further memory is allocated.
+			 */
+			void getLine(std::string& line, char delimiter = '\n');
+
+			/**
+			 * \brief   Get a whole line of input into a caller-owned buffer.
+			 * \details Stores at most \c size bytes of the line into \c buf (which is not
+			 *          null-terminated). If the line doesn't fit, then \c truncated is set and
+			 *          the remainder of the line is left for subsequent reads.
+			 * \returns the length of the (possibly truncated) line stored into \c buf
+			 */
+			unsigned long getLine(char *buf, unsigned long size, bool& truncated,
+			                      char delimiter = '\n');
 	};
 
 }
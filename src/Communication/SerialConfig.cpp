@@ -0,0 +1,30 @@
+#include "SerialConfig.h"
+using namespace metrobotics;
+
+SerialConfig::SerialConfig(unsigned int baudRate)
+:baudRate(baudRate),
+ charSize(8),
+ parity(NO_PARITY),
+ stopBits(1),
+ flowControl(NO_FLOW_CONTROL),
+ lowLatency(LEAVE_LOW_LATENCY),
+ inputBuffer(0),
+ outputBuffer(0)
+{
+}
+
+SerialConfig SerialConfig::throughput(unsigned int baudRate)
+{
+	SerialConfig config(baudRate);
+	config.inputBuffer = 4096;
+	config.outputBuffer = 4096;
+	return config;
+}
+
+SerialConfig SerialConfig::latency(unsigned int baudRate)
+{
+	SerialConfig config(baudRate);
+	config.lowLatency = ENABLE_LOW_LATENCY;
+	config.inputBuffer = 4096;
+	return config;
+}
@@ -0,0 +1,71 @@
+#ifndef METROBOTICS_SERIALCONFIG_H
+#define METROBOTICS_SERIALCONFIG_H
+
+namespace metrobotics
+{
+	/**
+	 * \struct  SerialConfig
+	 *
+	 * \brief   The configuration of a serial port.
+	 *
+	 * \details Collects the line settings (speed, framing and flow control), the driver's
+	 *          low-latency mode and the sizes of the port's own buffers in one place, so that a
+	 *          PosixSerial can be set up in one go, either when it's constructed or at any later
+	 *          time with PosixSerial::configure().
+	 *
+	 *          A plain configuration is raw 8N1 without flow control, which is what a port gets
+	 *          unless told otherwise. The named profiles start from there and tune it for a
+	 *          particular kind of traffic.
+	 */
+	struct SerialConfig
+	{
+		enum Parity { NO_PARITY, EVEN_PARITY, ODD_PARITY };
+		enum FlowControl { NO_FLOW_CONTROL, HARDWARE_FLOW_CONTROL, SOFTWARE_FLOW_CONTROL };
+		enum LowLatency { LEAVE_LOW_LATENCY, ENABLE_LOW_LATENCY, DISABLE_LOW_LATENCY };
+
+		/**
+		 * \brief   A plain configuration: raw 8N1 at the given speed, without flow control and
+		 *          without buffering; the driver's low-latency mode is left as it is.
+		 */
+		explicit SerialConfig(unsigned int baudRate = 9600);
+
+		/**
+		 * \brief   A profile for bulk transfers.
+		 * \details Input and output are buffered (so that many small transfers cost few system
+		 *          calls); the driver's low-latency mode is left as it is (use
+		 *          DISABLE_LOW_LATENCY to have the driver batch its deliveries).
+		 */
+		static SerialConfig throughput(unsigned int baudRate);
+
+		/**
+		 * \brief   A profile for request/response traffic.
+		 * \details The driver is asked to deliver input as soon as it arrives (which, on a
+		 *          typical USB-serial adapter, cuts the delivery delay from about 16 ms down to
+		 *          about 1 ms), and output goes out at once; input is still buffered, since that
+		 *          never holds anything back.
+		 */
+		static SerialConfig latency(unsigned int baudRate);
+
+		// [Line settings.]
+		// Remarks: the baud rate is given in bits per second, and may be any rate that the
+		// device supports (on Linux, that includes non-standard rates); for compatibility, the
+		// Bxxx constants of <termios.h> are accepted as well.
+		unsigned int baudRate;
+		unsigned int charSize;   // bits per character, 5 to 8
+		Parity parity;
+		unsigned int stopBits;   // 1 or 2
+		FlowControl flowControl;
+
+		// [Driver settings.]
+		// Remarks: low-latency mode is a Linux driver setting, which may well have been turned
+		// on by someone else (e.g. a udev rule or setserial); it's only ever changed when asked
+		// for. Devices that don't support it (e.g. pseudo-terminals) are left as they are.
+		LowLatency lowLatency;
+
+		// [Buffering.] (see PosixSerial::inputBuffer() and PosixSerial::outputBuffer())
+		unsigned long inputBuffer;
+		unsigned long outputBuffer;
+	};
+}
+
+#endif
@@ -0,0 +1,216 @@
+#include "SerialRecorder.h"
+#include "Timer/MonotonicTimer.h"
+using namespace metrobotics;
+
+#include <cstdio>
+#include <cstring>
+using namespace std;
+
+#include <unistd.h>
+
+// The signature at the start of every log file.
+static const unsigned char LOG_HEADER[SerialRecorder::HEADER_SIZE] = {
+	'M', 'U', 'S', 'R', 0x01, 0x00, 0x00, 0x00
+};
+
+// Transfers within this many nanoseconds of the start of a chunk are merged into it.
+static const long long MERGE_WINDOW = 1000000LL;
+
+// Store an integer in little-endian byte order.
+static void putLE(unsigned char *buf, unsigned long long value, unsigned long nBytes)
+{
+	for (unsigned long i = 0; i < nBytes; ++i) {
+		buf[i] = (value >> (8 * i)) & 0xFF;
+	}
+}
+
+// Load an integer stored in little-endian byte order.
+static unsigned long long getLE(const unsigned char *buf, unsigned long nBytes)
+{
+	unsigned long long value = 0;
+	for (unsigned long i = 0; i < nBytes; ++i) {
+		value |= (unsigned long long)buf[i] << (8 * i);
+	}
+	return value;
+}
+
+SerialRecorder::SerialRecorder(Serial& device, const char *path)
+:mDevice(device),
+ mLog(0),
+ mChunkDir(INPUT),
+ mChunkTime(0)
+{
+	if (path == 0) {
+		throw NullPointer();
+	}
+	if ((mLog = fopen(path, "a+b")) == 0) {
+		throw LogFailure();
+	}
+	if (!openSession()) {
+		fclose(mLog);
+		throw LogFailure();
+	}
+}
+
+bool SerialRecorder::openSession()
+{
+	// A new log needs its header; an existing one must be a log, and is appended to.
+	fseek(mLog, 0, SEEK_END);
+	long size = ftell(mLog);
+	if (size < 0) {
+		return false;
+	} else if (size == 0) {
+		if (fwrite(LOG_HEADER, 1, HEADER_SIZE, mLog) != HEADER_SIZE) {
+			return false;
+		}
+	} else {
+		unsigned char header[HEADER_SIZE];
+		fseek(mLog, 0, SEEK_SET);
+		if (fread(header, 1, HEADER_SIZE, mLog) != HEADER_SIZE ||
+		    memcmp(header, LOG_HEADER, HEADER_SIZE) != 0) {
+			return false;
+		}
+		// Remarks: a chunk that was cut short (e.g. by a crash) would swallow whatever follows
+		// it, so the log is truncated to the last chunk that is complete.
+		long end = HEADER_SIZE;
+		unsigned char chunk[CHUNK_HEADER_SIZE];
+		while (fread(chunk, 1, CHUNK_HEADER_SIZE, mLog) == CHUNK_HEADER_SIZE) {
+			long next = end + CHUNK_HEADER_SIZE + (long)(getLE(chunk + 8, 4) >> 1);
+			if (next > size || fseek(mLog, next, SEEK_SET) != 0) {
+				break;
+			}
+			end = next;
+		}
+		if (end < size && (fflush(mLog) != 0 || ftruncate(fileno(mLog), end) != 0)) {
+			return false;
+		}
+		fseek(mLog, 0, SEEK_END);
+	}
+	// Remarks: time stamps from different sessions (let alone different boots) aren't
+	// comparable, so every session begins with a marker that playback is timed from.
+	unsigned char marker[CHUNK_HEADER_SIZE];
+	putLE(marker, MonotonicTimer::now(), 8);
+	putLE(marker + 8, 0, 4);
+	return fwrite(marker, 1, CHUNK_HEADER_SIZE, mLog) == CHUNK_HEADER_SIZE;
+}
+
+SerialRecorder::~SerialRecorder()
+{
+	try {
+		writeChunk();
+	} catch (...) {
+		// Nothing more can be done about it now.
+	}
+	fclose(mLog);
+}
+
+void SerialRecorder::record(Direction dir, const unsigned char *buf, unsigned long nBytes)
+{
+	if (nBytes == 0) {
+		return;
+	}
+	long long t = MonotonicTimer::now();
+	if (!mChunk.empty() && (dir != mChunkDir || t - mChunkTime > MERGE_WINDOW)) {
+		writeChunk();
+	}
+	if (mChunk.empty()) {
+		mChunkDir = dir;
+		mChunkTime = t;
+	}
+	mChunk.insert(mChunk.end(), buf, buf + nBytes);
+}
+
+void SerialRecorder::writeChunk()
+{
+	if (mChunk.empty()) {
+		return;
+	}
+	unsigned char header[CHUNK_HEADER_SIZE];
+	putLE(header, mChunkTime, 8);
+	putLE(header + 8, ((unsigned long long)mChunk.size() << 1) | mChunkDir, 4);
+	unsigned long n = mChunk.size();
+	bool ok = fwrite(header, 1, CHUNK_HEADER_SIZE, mLog) == CHUNK_HEADER_SIZE &&
+	          fwrite(&mChunk[0], 1, n, mLog) == n;
+	mChunk.clear();
+	if (!ok) {
+		throw LogFailure();
+	}
+}
+
+void SerialRecorder::sync()
+{
+	writeChunk();
+	if (fflush(mLog) != 0) {
+		throw LogFailure();
+	}
+}
+
+void SerialRecorder::flushInput()
+{
+	mDevice.flushInput();
+}
+
+unsigned char SerialRecorder::getByte()
+{
+	unsigned char b = mDevice.getByte();
+	record(INPUT, &b, 1);
+	return b;
+}
+
+void SerialRecorder::getBlock(unsigned char *buf, unsigned long nBytes)
+{
+	mDevice.getBlock(buf, nBytes);
+	record(INPUT, buf, nBytes);
+}
+
+unsigned long SerialRecorder::getDelimited(unsigned char *buf, unsigned long nBytes,
+                                           unsigned char delimiter)
+{
+	unsigned long n = mDevice.getDelimited(buf, nBytes, delimiter);
+	record(INPUT, buf, n);
+	return n;
+}
+
+IoResult SerialRecorder::readSome(unsigned char *buf, unsigned long nBytes, int ms)
+{
+	IoResult r = mDevice.readSome(buf, nBytes, ms);
+	record(INPUT, buf, r.nBytes);
+	return r;
+}
+
+void SerialRecorder::flushOutput()
+{
+	mDevice.flushOutput();
+}
+
+void SerialRecorder::putByte(const unsigned char b)
+{
+	mDevice.putByte(b);
+	record(OUTPUT, &b, 1);
+}
+
+void SerialRecorder::putBlock(const unsigned char *buf, unsigned long nBytes)
+{
+	mDevice.putBlock(buf, nBytes);
+	record(OUTPUT, buf, nBytes);
+}
+
+IoResult SerialRecorder::writeSome(const unsigned char *buf, unsigned long nBytes, int ms)
+{
+	IoResult r = mDevice.writeSome(buf, nBytes, ms);
+	record(OUTPUT, buf, r.nBytes);
+	return r;
+}
+
+void SerialRecorder::putBlocks(const DataBlock *blocks, unsigned long nBlocks)
+{
+	mDevice.putBlocks(blocks, nBlocks);
+	for (unsigned long i = 0; i < nBlocks; ++i) {
+		record(OUTPUT, blocks[i].buf, blocks[i].nBytes);
+	}
+}
+
+void SerialRecorder::commitOutput()
+{
+	mDevice.commitOutput();
+}
@@ -0,0 +1,106 @@
+#ifndef METROBOTICS_SERIALRECORDER_H
+#define METROBOTICS_SERIALRECORDER_H
+
+#include "Serial.h"
+#include <cstdio>
+#include <vector>
+
+namespace metrobotics
+{
+	/**
+	 * \class   SerialRecorder
+	 *
+	 * \brief   A Serial device that records all traffic of another Serial device.
+	 *
+	 * \details The recorder stands in for the device that it wraps: every call is passed on to
+	 *          that device, and every byte that goes in either direction is appended to a log
+	 *          file, which can later be played back with ReplaySerial.
+	 *
+	 *          The log is a compact, append-only binary file. It starts with the 8-byte header
+	 *          <tt>"MUSR" 0x01 0x00 0x00 0x00</tt>, followed by any number of chunks; each chunk
+	 *          is a 12-byte header followed by the chunk's data:
+	 *          <ul>
+	 *            <li>the time at which the chunk was transferred, in nanoseconds on the
+	 *                monotonic clock (8 bytes, little-endian)</li>
+	 *            <li>the chunk's length shifted left by one, with the lowest bit set for output
+	 *                and clear for input (4 bytes, little-endian)</li>
+	 *          </ul>
+	 *          Transfers in the same direction that follow each other within a millisecond are
+	 *          merged into one chunk, so that byte-by-byte traffic doesn't drown in headers.
+	 *
+	 *          Every recording session (i.e. every recorder that opens the log) begins with a
+	 *          session marker: a chunk of input with no data, whose time is the start of the
+	 *          session. Time stamps are only comparable within a session.
+	 */
+	class SerialRecorder : public Serial
+	{
+		public:
+			// [Exceptions.]
+			class LogFailure {};
+
+			/**
+			 * \brief   Start recording the traffic of a device.
+			 *
+			 * \arg     device is the device to record; it must outlive the recorder
+			 * \arg     path is the log file, which is created or appended to
+			 *
+			 * \exception LogFailure is thrown when the log file can't be opened, or when it
+			 *            exists but isn't a log
+			 */
+			SerialRecorder(Serial& device, const char *path);
+
+			/**
+			 * \brief   Stop recording; everything recorded so far is written out to the log.
+			 */
+			~SerialRecorder();
+
+			// [Implement input capabilities.]
+			void flushInput();
+			unsigned char getByte();
+			void getBlock(unsigned char *buf, unsigned long nBytes);
+			unsigned long getDelimited(unsigned char *buf, unsigned long nBytes,
+			                           unsigned char delimiter);
+			IoResult readSome(unsigned char *buf, unsigned long nBytes, int ms = -1);
+
+			// [Implement output capabilities.]
+			void flushOutput();
+			void putByte(const unsigned char);
+			void putBlock(const unsigned char *buf, unsigned long nBytes);
+			IoResult writeSome(const unsigned char *buf, unsigned long nBytes, int ms = -1);
+			void putBlocks(const DataBlock *blocks, unsigned long nBlocks);
+			void commitOutput();
+
+			// [Class-specific capabilities.]
+			/**
+			 * \brief   Write everything recorded so far out to the log file.
+			 */
+			void sync();
+
+			// [Log format.]
+			enum Direction { INPUT = 0, OUTPUT = 1 };
+			enum { HEADER_SIZE = 8, CHUNK_HEADER_SIZE = 12 };
+
+		private:
+			// Disable copying and assignment for SerialRecorder objects.
+			SerialRecorder(const SerialRecorder&);
+			SerialRecorder& operator=(const SerialRecorder&);
+
+			// Prepare the log for a new session, and mark its start.
+			bool openSession();
+
+			// Record traffic in the given direction.
+			void record(Direction dir, const unsigned char *buf, unsigned long nBytes);
+
+			// Append the pending chunk to the log.
+			void writeChunk();
+
+			// Internal state members.
+			Serial& mDevice;
+			std::FILE *mLog;
+			std::vector<unsigned char> mChunk; // pending chunk, not yet in the log
+			Direction mChunkDir;
+			long long mChunkTime; // in nanoseconds
+	};
+}
+
+#endif
@@ -0,0 +1,515 @@
+#include "SharedSerial.h"
+using namespace metrobotics;
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <new>
+using namespace std;
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Identifies the memory of a link (and the version of its layout).
+static const unsigned long LINK_MAGIC = 0x4d55534cUL; // "MUSL"
+
+// How long (in milliseconds) to wait for the creator of a named link to finish laying it out.
+static const int ATTACH_TIME = 1000;
+
+// Round a size up to a whole number of cache lines.
+static unsigned long lines(unsigned long nBytes)
+{
+	return (nBytes + 63) & ~63UL;
+}
+
+// Lock a mutex that may have been left locked by a process that died while holding it.
+static void lock(pthread_mutex_t *mutex)
+{
+	if (pthread_mutex_lock(mutex) == EOWNERDEAD) {
+		pthread_mutex_consistent(mutex);
+	}
+}
+
+// Wake up whoever is waiting on cond (if anyone is), after the ring has been updated.
+static void notify(atomic<bool>& waiting, pthread_mutex_t *mutex, pthread_cond_t *cond)
+{
+	// Remarks: pairs with the fence in SharedSerial::wait(); either the waiter sees the update,
+	// or we see the waiter.
+	atomic_thread_fence(memory_order_seq_cst);
+	if (waiting.load(memory_order_relaxed)) {
+		lock(mutex);
+		pthread_cond_signal(cond);
+		pthread_mutex_unlock(mutex);
+	}
+}
+
+// Wake up whoever is waiting on cond, no matter what.
+static void broadcast(pthread_mutex_t *mutex, pthread_cond_t *cond)
+{
+	lock(mutex);
+	pthread_cond_broadcast(cond);
+	pthread_mutex_unlock(mutex);
+}
+
+// Determine whether there's input in the ring (or, if not reading, room for output).
+static bool ready(const ByteRing *ring, bool reading)
+{
+	return reading ? ring->readable() > 0 : ring->writable() > 0;
+}
+
+// Throw the exception that corresponds to a failed read (or write).
+static void read_failed(IoStatus status)
+{
+	if (status == IO_TIMEOUT) {
+		throw Serial::ReadTimeout();
+	}
+	throw Serial::ReadFailure();
+}
+
+static void write_failed(IoStatus status)
+{
+	if (status == IO_TIMEOUT) {
+		throw Serial::WriteTimeout();
+	}
+	throw Serial::WriteFailure();
+}
+
+// The state of one direction of a link.
+struct SharedLink::Channel
+{
+	pthread_mutex_t lock;       // guards the waits below (but never the ring)
+	pthread_cond_t dataReady;   // signalled by the writer
+	pthread_cond_t spaceReady;  // signalled by the reader
+	atomic<bool> readerWaiting;
+	atomic<bool> writerWaiting;
+	atomic<bool> readerClosed;
+	atomic<bool> writerClosed;
+	unsigned long ring;         // offset of the ring from the start of the link
+};
+
+// The link's memory: this header, followed by the rings of both directions.
+struct SharedLink::Layout
+{
+	unsigned long magic;
+	atomic<unsigned int> ready; // set once the creator is done laying out the link
+	unsigned long capacity;
+	unsigned long size;
+	Channel channels[2];
+};
+
+unsigned long SharedLink::size(unsigned long nBytes)
+{
+	return lines(sizeof(Layout)) + 2 * lines(ByteRing::footprint(nBytes));
+}
+
+void SharedLink::initialize(void *memory, unsigned long nBytes)
+{
+	Layout *layout = new (memory) Layout;
+	layout->magic = LINK_MAGIC;
+	layout->ready.store(0, memory_order_relaxed);
+	layout->size = size(nBytes);
+
+	// Remarks: the link may be shared by processes, and any of them may die at any time.
+	pthread_mutexattr_t mutexAttr;
+	pthread_mutexattr_init(&mutexAttr);
+	pthread_mutexattr_setpshared(&mutexAttr, PTHREAD_PROCESS_SHARED);
+	pthread_mutexattr_setrobust(&mutexAttr, PTHREAD_MUTEX_ROBUST);
+	pthread_condattr_t condAttr;
+	pthread_condattr_init(&condAttr);
+	pthread_condattr_setpshared(&condAttr, PTHREAD_PROCESS_SHARED);
+	pthread_condattr_setclock(&condAttr, CLOCK_MONOTONIC);
+
+	unsigned long offset = lines(sizeof(Layout));
+	for (int i = 0; i < 2; ++i) {
+		Channel& ch = layout->channels[i];
+		pthread_mutex_init(&ch.lock, &mutexAttr);
+		pthread_cond_init(&ch.dataReady, &condAttr);
+		pthread_cond_init(&ch.spaceReady, &condAttr);
+		ch.readerWaiting.store(false, memory_order_relaxed);
+		ch.writerWaiting.store(false, memory_order_relaxed);
+		ch.readerClosed.store(false, memory_order_relaxed);
+		ch.writerClosed.store(false, memory_order_relaxed);
+		ch.ring = offset;
+		ByteRing *ring = ByteRing::place((unsigned char *)memory + offset, nBytes);
+		layout->capacity = ring->capacity();
+		offset += lines(ByteRing::footprint(nBytes));
+	}
+
+	pthread_condattr_destroy(&condAttr);
+	pthread_mutexattr_destroy(&mutexAttr);
+}
+
+SharedLink::SharedLink(unsigned long nBytes)
+:mLayout(0),
+ mSize(size(nBytes)),
+ mCreator(true)
+{
+	void *memory = mmap(0, mSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (memory == MAP_FAILED) {
+		throw LinkFailure();
+	}
+	initialize(memory, nBytes);
+	mLayout = static_cast<Layout *>(memory);
+	mLayout->ready.store(1, memory_order_release);
+}
+
+SharedLink::SharedLink(const char *name, unsigned long nBytes)
+:mLayout(0),
+ mSize(0),
+ mName(name != 0 ? name : ""),
+ mCreator(false)
+{
+	if (name == 0) {
+		throw LinkFailure();
+	}
+
+	// Create the link, unless it already exists.
+	int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd >= 0) {
+		mCreator = true;
+		mSize = size(nBytes);
+		if (ftruncate(fd, mSize) < 0) {
+			close(fd);
+			shm_unlink(name);
+			throw LinkFailure();
+		}
+	} else if (errno != EEXIST || (fd = shm_open(name, O_RDWR, 0)) < 0) {
+		throw LinkFailure();
+	} else {
+		// Remarks: the creator may not have gotten around to sizing the link yet.
+		struct stat st;
+		for (int t = 0; ; ++t) {
+			if (fstat(fd, &st) < 0 || t == ATTACH_TIME) {
+				close(fd);
+				throw LinkFailure();
+			}
+			if (st.st_size > 0) {
+				break;
+			}
+			usleep(1000);
+		}
+		mSize = st.st_size;
+	}
+
+	void *memory = mmap(0, mSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	// Remarks: the mapping outlives the descriptor.
+	close(fd);
+	if (memory == MAP_FAILED) {
+		if (mCreator) {
+			shm_unlink(name);
+		}
+		throw LinkFailure();
+	}
+	mLayout = static_cast<Layout *>(memory);
+
+	if (mCreator) {
+		initialize(memory, nBytes);
+		mLayout->ready.store(1, memory_order_release);
+		return;
+	}
+
+	// Wait for the creator to lay out the link, and make sure that it is a link.
+	for (int t = 0; mLayout->ready.load(memory_order_acquire) == 0; ++t) {
+		if (t == ATTACH_TIME) {
+			munmap(memory, mSize);
+			throw LinkFailure();
+		}
+		usleep(1000);
+	}
+	if (mSize < sizeof(Layout) || mLayout->magic != LINK_MAGIC || mLayout->size != mSize) {
+		munmap(memory, mSize);
+		throw LinkFailure();
+	}
+}
+
+SharedLink::~SharedLink()
+{
+	munmap(mLayout, mSize);
+	if (mCreator && !mName.empty()) {
+		shm_unlink(mName.c_str());
+	}
+}
+
+unsigned long SharedLink::capacity() const
+{
+	return mLayout->capacity;
+}
+
+void SharedLink::remove(const char *name)
+{
+	if (name != 0) {
+		shm_unlink(name);
+	}
+}
+
+SharedLink::Channel& SharedLink::channel(int i) const
+{
+	return mLayout->channels[i];
+}
+
+ByteRing& SharedLink::ring(int i) const
+{
+	return *reinterpret_cast<ByteRing *>((unsigned char *)mLayout + channel(i).ring);
+}
+
+SharedSerial::SharedSerial(SharedLink& link, SharedLink::End end)
+:mIn(&link.channel(end == SharedLink::FIRST_END ? 1 : 0)),
+ mOut(&link.channel(end == SharedLink::FIRST_END ? 0 : 1)),
+ mInRing(&link.ring(end == SharedLink::FIRST_END ? 1 : 0)),
+ mOutRing(&link.ring(end == SharedLink::FIRST_END ? 0 : 1)),
+ mTimeOut(0)
+{
+	// Remarks: this end may have been opened (and closed) before.
+	mIn->readerClosed.store(false, memory_order_release);
+	mOut->writerClosed.store(false, memory_order_release);
+}
+
+SharedSerial::~SharedSerial()
+{
+	mIn->readerClosed.store(true, memory_order_release);
+	mOut->writerClosed.store(true, memory_order_release);
+	broadcast(&mIn->lock, &mIn->spaceReady);
+	broadcast(&mOut->lock, &mOut->dataReady);
+}
+
+IoStatus SharedSerial::wait(bool reading, int ms)
+{
+	SharedLink::Channel *ch = reading ? mIn : mOut;
+	ByteRing *ring = reading ? mInRing : mOutRing;
+	atomic<bool>& waiting = reading ? ch->readerWaiting : ch->writerWaiting;
+	atomic<bool>& gone = reading ? ch->writerClosed : ch->readerClosed;
+	pthread_cond_t *cond = reading ? &ch->dataReady : &ch->spaceReady;
+
+	// Remarks: whatever the other end sent before it went away can still be read.
+	if (ready(ring, reading)) {
+		return IO_OK;
+	}
+	if (gone.load(memory_order_acquire)) {
+		return ready(ring, reading) ? IO_OK : IO_FAILURE;
+	}
+	if (ms == 0) {
+		return IO_TIMEOUT;
+	}
+
+	struct timespec deadline;
+	if (ms > 0) {
+		clock_gettime(CLOCK_MONOTONIC, &deadline);
+		deadline.tv_sec += ms / 1000;
+		deadline.tv_nsec += (ms % 1000) * 1000000L;
+		if (deadline.tv_nsec >= 1000000000L) {
+			deadline.tv_sec += 1;
+			deadline.tv_nsec -= 1000000000L;
+		}
+	}
+
+	IoStatus status = IO_OK;
+	lock(&ch->lock);
+	waiting.store(true, memory_order_relaxed);
+	atomic_thread_fence(memory_order_seq_cst);
+	while (!ready(ring, reading)) {
+		if (gone.load(memory_order_acquire)) {
+			status = ready(ring, reading) ? IO_OK : IO_FAILURE;
+			break;
+		}
+		int r = ms < 0 ? pthread_cond_wait(cond, &ch->lock)
+		               : pthread_cond_timedwait(cond, &ch->lock, &deadline);
+		if (r == EOWNERDEAD) {
+			pthread_mutex_consistent(&ch->lock);
+		} else if (r == ETIMEDOUT) {
+			status = ready(ring, reading) ? IO_OK : IO_TIMEOUT;
+			break;
+		}
+	}
+	waiting.store(false, memory_order_relaxed);
+	pthread_mutex_unlock(&ch->lock);
+	return status;
+}
+
+void SharedSerial::produced()
+{
+	notify(mOut->readerWaiting, &mOut->lock, &mOut->dataReady);
+}
+
+void SharedSerial::consumed()
+{
+	notify(mIn->writerWaiting, &mIn->lock, &mIn->spaceReady);
+}
+
+int SharedSerial::waitTime() const
+{
+	return mTimeOut == 0 ? -1 : (int)mTimeOut;
+}
+
+void SharedSerial::flushInput()
+{
+	unsigned long n = mInRing->readable();
+	if (n > 0) {
+		mInRing->commitRead(n);
+		consumed();
+	}
+}
+
+unsigned char SharedSerial::getByte()
+{
+	unsigned char b;
+	while (mInRing->read(&b, 1) == 0) {
+		IoStatus status = wait(true, waitTime());
+		if (status != IO_OK) {
+			read_failed(status);
+		}
+	}
+	consumed();
+	return b;
+}
+
+void SharedSerial::getBlock(unsigned char *buf, unsigned long nBytes)
+{
+	if (buf == 0) {
+		throw NullPointer();
+	}
+	while (nBytes > 0) {
+		unsigned long n = mInRing->read(buf, nBytes);
+		if (n > 0) {
+			consumed();
+			buf += n;
+			nBytes -= n;
+		} else {
+			IoStatus status = wait(true, waitTime());
+			if (status != IO_OK) {
+				read_failed(status);
+			}
+		}
+	}
+}
+
+unsigned long SharedSerial::getDelimited(unsigned char *buf, unsigned long nBytes,
+                                         unsigned char delimiter)
+{
+	if (buf == 0) {
+		throw NullPointer();
+	}
+	unsigned long total = 0;
+	while (total < nBytes) {
+		// Scan the ring in place.
+		const unsigned char *src;
+		unsigned long n = min(nBytes - total, mInRing->readSpace(&src));
+		if (n == 0) {
+			IoStatus status = wait(true, waitTime());
+			if (status != IO_OK) {
+				read_failed(status);
+			}
+			continue;
+		}
+		const void *hit = memchr(src, delimiter, n);
+		if (hit != 0) {
+			n = (const unsigned char *)hit - src + 1;
+		}
+		memcpy(buf + total, src, n);
+		mInRing->commitRead(n);
+		consumed();
+		total += n;
+		if (hit != 0) {
+			break;
+		}
+	}
+	return total;
+}
+
+IoResult SharedSerial::readSome(unsigned char *buf, unsigned long nBytes, int ms)
+{
+	if (buf == 0) {
+		throw NullPointer();
+	}
+	IoResult r;
+	r.nBytes = 0;
+	r.status = IO_OK;
+	if (nBytes == 0) {
+		return r;
+	}
+	if ((r.nBytes = mInRing->read(buf, nBytes)) == 0) {
+		r.status = wait(true, ms < 0 ? waitTime() : ms);
+		if (r.status == IO_OK) {
+			r.nBytes = mInRing->read(buf, nBytes);
+		}
+	}
+	if (r.nBytes > 0) {
+		consumed();
+	}
+	return r;
+}
+
+void SharedSerial::flushOutput()
+{
+	// Output is handed to the other end as soon as it's written; there's nothing left to flush.
+}
+
+void SharedSerial::putByte(const unsigned char b)
+{
+	putBlock(&b, 1);
+}
+
+void SharedSerial::putBlock(const unsigned char *buf, unsigned long nBytes)
+{
+	if (buf == 0) {
+		throw NullPointer();
+	}
+	while (nBytes > 0) {
+		// Remarks: output to an end that has gone away would never be read.
+		if (mOut->readerClosed.load(memory_order_acquire)) {
+			throw WriteFailure();
+		}
+		unsigned long n = mOutRing->write(buf, nBytes);
+		if (n > 0) {
+			produced();
+			buf += n;
+			nBytes -= n;
+		} else {
+			IoStatus status = wait(false, waitTime());
+			if (status != IO_OK) {
+				write_failed(status);
+			}
+		}
+	}
+}
+
+IoResult SharedSerial::writeSome(const unsigned char *buf, unsigned long nBytes, int ms)
+{
+	if (buf == 0) {
+		throw NullPointer();
+	}
+	IoResult r;
+	r.nBytes = 0;
+	r.status = IO_OK;
+	if (nBytes == 0) {
+		return r;
+	}
+	if (mOut->readerClosed.load(memory_order_acquire)) {
+		r.status = IO_FAILURE;
+		return r;
+	}
+	if ((r.nBytes = mOutRing->write(buf, nBytes)) == 0) {
+		r.status = wait(false, ms < 0 ? waitTime() : ms);
+		if (r.status == IO_OK) {
+			r.nBytes = mOutRing->write(buf, nBytes);
+		}
+	}
+	if (r.nBytes > 0) {
+		produced();
+	}
+	return r;
+}
+
+void SharedSerial::timeout(unsigned int ms)
+{
+	mTimeOut = ms;
+}
+
+unsigned long SharedSerial::available() const
+{
+	return mInRing->readable();
+}
@@ -0,0 +1,172 @@
+#ifndef METROBOTICS_SHAREDSERIAL_H
+#define METROBOTICS_SHAREDSERIAL_H
+
+#include "Serial.h"
+#include "ByteRing.h"
+#include <string>
+
+namespace metrobotics
+{
+	/**
+	 * \class   SharedLink
+	 *
+	 * \brief   A serial link in memory: a lock-free ring buffer for each direction.
+	 *
+	 * \details The link is either private to the process (for ends on different threads, or in
+	 *          processes forked after the link was made) or a named POSIX shared-memory object
+	 *          (for ends in unrelated processes). Either way, the link's two ends are
+	 *          SharedSerial objects, which exchange bytes without a single system call as long
+	 *          as neither of them has to wait for the other.
+	 *
+	 *          The first process to open a named link creates it, and removes the name again
+	 *          once it's done with the link; the second one attaches to it.
+	 */
+	class SharedLink
+	{
+		public:
+			// [Exceptions.]
+			class LinkFailure {};
+
+			// The two ends of a link.
+			enum End { FIRST_END, SECOND_END };
+
+			/**
+			 * \brief   Create a private link.
+			 *
+			 * \arg     nBytes is the minimum capacity of each direction (rounded up to a power
+			 *          of two)
+			 */
+			explicit SharedLink(unsigned long nBytes = 65536);
+
+			/**
+			 * \brief   Create or attach to a named link.
+			 *
+			 * \arg     name is the name of the shared-memory object (e.g. "/robot")
+			 * \arg     nBytes is the minimum capacity of each direction, if the link is created;
+			 *          a link that is attached to keeps the capacity that it was created with
+			 *
+			 * \exception LinkFailure is thrown when the link can't be created or attached to
+			 */
+			SharedLink(const char *name, unsigned long nBytes = 65536);
+
+			/**
+			 * \brief   Detach from the link (and remove its name, if this is its creator).
+			 */
+			~SharedLink();
+
+			/**
+			 * \brief   The number of bytes that each direction can hold.
+			 */
+			unsigned long capacity() const;
+
+			/**
+			 * \brief   Remove a named link that was left behind (e.g. by a crashed process).
+			 */
+			static void remove(const char *name);
+
+		private:
+			// Disable copying and assignment for SharedLink objects.
+			SharedLink(const SharedLink&);
+			SharedLink& operator=(const SharedLink&);
+
+			friend class SharedSerial;
+
+			// The link's memory, and the state of one direction within it.
+			struct Layout;
+			struct Channel;
+
+			// Lay out a new link in the given memory.
+			static void initialize(void *memory, unsigned long nBytes);
+
+			// The size (in bytes) of a link with the given capacity.
+			static unsigned long size(unsigned long nBytes);
+
+			// Direction i of the link, and its ring.
+			Channel& channel(int i) const;
+			ByteRing& ring(int i) const;
+
+			// Internal state members.
+			Layout *mLayout;
+			unsigned long mSize;
+			std::string mName; // empty for private links
+			bool mCreator;
+	};
+
+	/**
+	 * \class   SharedSerial
+	 *
+	 * \brief   One end of a SharedLink.
+	 *
+	 * \details Behaves like any other Serial device: whatever is put into one end comes out of
+	 *          the other. Reads block (for up to timeout()) while the link is empty, and writes
+	 *          block while it's full; when the other end goes away, reads fail with ReadFailure
+	 *          once everything that it sent has been read, and writes fail with WriteFailure.
+	 *
+	 * \warning Each end of a link must be opened by no more than one SharedSerial at a time, and
+	 *          each SharedSerial must be used by no more than one thread at a time.
+	 */
+	class SharedSerial : public Serial
+	{
+		public:
+			/**
+			 * \brief   Open one end of a link; the link must outlive it.
+			 */
+			SharedSerial(SharedLink& link, SharedLink::End end);
+
+			/**
+			 * \brief   Close this end of the link.
+			 */
+			~SharedSerial();
+
+			// [Implement input capabilities.]
+			void flushInput();
+			unsigned char getByte();
+			void getBlock(unsigned char *buf, unsigned long nBytes);
+			unsigned long getDelimited(unsigned char *buf, unsigned long nBytes,
+			                           unsigned char delimiter);
+			IoResult readSome(unsigned char *buf, unsigned long nBytes, int ms = -1);
+
+			// [Implement output capabilities.]
+			void flushOutput();
+			void putByte(const unsigned char);
+			void putBlock(const unsigned char *buf, unsigned long nBytes);
+			IoResult writeSome(const unsigned char *buf, unsigned long nBytes, int ms = -1);
+
+			// [Class-specific capabilities.]
+			/**
+			 * \brief   Set a timeout (in milliseconds) for all I/O operations.
+			 * \details A timeout of 0 (the default) may block I/O indefinitely.
+			 */
+			void timeout(unsigned int ms = 0);
+
+			/**
+			 * \brief   The number of bytes of input that can be had without blocking.
+			 */
+			unsigned long available() const;
+
+		private:
+			// Disable copying and assignment for SharedSerial objects.
+			SharedSerial(const SharedSerial&);
+			SharedSerial& operator=(const SharedSerial&);
+
+			// Wait until there's input (or, if not reading, room for output), until the other
+			// end has gone away, or until we're out of time (never, if ms is negative).
+			IoStatus wait(bool reading, int ms);
+
+			// Let the other end know that there's input for it (or room for its output).
+			void produced();
+			void consumed();
+
+			// The timeout in the form that the waiting functions expect (negative for forever).
+			int waitTime() const;
+
+			// Internal state members.
+			SharedLink::Channel *mIn;
+			SharedLink::Channel *mOut;
+			ByteRing *mInRing;
+			ByteRing *mOutRing;
+			unsigned int mTimeOut; // in milliseconds
+	};
+}
+
+#endif
@@ -0,0 +1,276 @@
+#ifndef METROBOTICS_WIREFORMAT_H
+#define METROBOTICS_WIREFORMAT_H
+
+#include "Serial.h"
+#include "../Math/VectorN.h"
+#include "../Math/RealVectorN.h"
+#include <cstring>
+#include <limits>
+
+namespace metrobotics
+{
+	/**
+	 * \class   WireFormat
+	 *
+	 * \brief   Encodes vectors into (and decodes them from) a compact binary form.
+	 *
+	 * \details A vector goes on the wire as its entries, one after the other, each in its
+	 *          binary form and in the format's byte order; there's no framing, so both ends must
+	 *          agree on the format, the type of the entries and the dimension. Integral entries
+	 *          take as many bytes as their type does. Real entries are IEEE 754 numbers: 64 bits
+	 *          wide by default, or 32 bits wide in the compact format, which halves the size of
+	 *          a RealVectorN (and makes it about a quarter of its size as text) at the cost of
+	 *          precision beyond about seven significant digits.
+	 *
+	 *          Arrays of vectors are encoded into a small buffer on the stack and handed to the
+	 *          sink a buffer at a time (or taken from the source likewise), so neither side ever
+	 *          formats or parses text. The entries of the vectors must be of an arithmetic type.
+	 */
+	class WireFormat
+	{
+		public:
+			// The order of the bytes within each entry.
+			enum ByteOrder { LITTLE_ENDIAN_ORDER, BIG_ENDIAN_ORDER };
+
+			// The width of real (floating-point) entries.
+			enum RealFormat { FLOAT64, FLOAT32 };
+
+			/**
+			 * \brief   Construct a format.
+			 *
+			 * \arg     order is the byte order on the wire (little-endian, by default)
+			 * \arg     real determines whether real entries are sent as 64-bit or (compact)
+			 *          32-bit numbers
+			 */
+			explicit WireFormat(ByteOrder order = LITTLE_ENDIAN_ORDER, RealFormat real = FLOAT64)
+			:mOrder(order),
+			 mReal(real)
+			{
+			}
+
+			/**
+			 * \brief   The format's byte order and width of real entries.
+			 */
+			ByteOrder byteOrder() const
+			{
+				return mOrder;
+			}
+
+			RealFormat realFormat() const
+			{
+				return mReal;
+			}
+
+			/**
+			 * \brief   The number of bytes that an entry of type T takes on the wire.
+			 */
+			template <class T>
+			unsigned long entrySize() const
+			{
+				if (std::numeric_limits<T>::is_integer) {
+					return sizeof(T);
+				}
+				return mReal == FLOAT32 ? 4 : 8;
+			}
+
+			/**
+			 * \brief   The number of bytes that a vector takes on the wire.
+			 */
+			template <class T, size_t N>
+			unsigned long size(const VectorN<T, N>&) const
+			{
+				return N * entrySize<T>();
+			}
+
+			// [Buffers.]
+			/**
+			 * \brief   Encode a vector into a buffer of (at least) size(v) bytes.
+			 *
+			 * \returns the number of bytes stored into \c buf
+			 */
+			template <class T, size_t N>
+			unsigned long encode(const VectorN<T, N>& v, unsigned char *buf) const
+			{
+				unsigned long width = entrySize<T>();
+				for (size_t i = 0; i < N; ++i) {
+					putEntry(buf + i * width, v[i], width);
+				}
+				return N * width;
+			}
+
+			/**
+			 * \brief   Decode a vector from a buffer of (at least) size(v) bytes.
+			 *
+			 * \returns the number of bytes taken from \c buf
+			 */
+			template <class T, size_t N>
+			unsigned long decode(const unsigned char *buf, VectorN<T, N>& v) const
+			{
+				unsigned long width = entrySize<T>();
+				for (size_t i = 0; i < N; ++i) {
+					getEntry(buf + i * width, v[i], width);
+				}
+				return N * width;
+			}
+
+			// [Streams.]
+			/**
+			 * \brief   Encode an array of vectors and put it to a sink.
+			 */
+			template <class T, size_t N>
+			void write(DataSink& sink, const VectorN<T, N> *v, unsigned long count) const
+			{
+				writeArray<T, N>(sink, v, count);
+			}
+
+			template <size_t N>
+			void write(DataSink& sink, const RealVectorN<N> *v, unsigned long count) const
+			{
+				writeArray<double, N>(sink, v, count);
+			}
+
+			template <class T, size_t N>
+			void write(DataSink& sink, const VectorN<T, N>& v) const
+			{
+				writeArray<T, N>(sink, &v, 1);
+			}
+
+			/**
+			 * \brief   Get an array of vectors from a source and decode it.
+			 *
+			 * \details Blocks (as the source does) until all of the vectors have arrived; the
+			 *          source's exceptions are passed on.
+			 */
+			template <class T, size_t N>
+			void read(DataSource& source, VectorN<T, N> *v, unsigned long count) const
+			{
+				readArray<T, N>(source, v, count);
+			}
+
+			template <size_t N>
+			void read(DataSource& source, RealVectorN<N> *v, unsigned long count) const
+			{
+				readArray<double, N>(source, v, count);
+			}
+
+			template <class T, size_t N>
+			void read(DataSource& source, VectorN<T, N>& v) const
+			{
+				readArray<T, N>(source, &v, 1);
+			}
+
+		private:
+			//! @cond INTERNAL
+			// The size of the buffer that arrays are encoded into (and decoded from).
+			enum { CHUNK_SIZE = 512 };
+
+			// Store (load) the lowest nBytes bytes of an entry's bits in the wire's byte order.
+			void putBits(unsigned char *buf, unsigned long long bits, unsigned long nBytes) const
+			{
+				for (unsigned long i = 0; i < nBytes; ++i) {
+					unsigned long shift = 8 * (mOrder == LITTLE_ENDIAN_ORDER ? i : nBytes - 1 - i);
+					buf[i] = (bits >> shift) & 0xFF;
+				}
+			}
+
+			unsigned long long getBits(const unsigned char *buf, unsigned long nBytes) const
+			{
+				unsigned long long bits = 0;
+				for (unsigned long i = 0; i < nBytes; ++i) {
+					unsigned long shift = 8 * (mOrder == LITTLE_ENDIAN_ORDER ? i : nBytes - 1 - i);
+					bits |= (unsigned long long)buf[i] << shift;
+				}
+				return bits;
+			}
+
+			// Encode (decode) a single entry that takes width bytes on the wire.
+			template <class T>
+			void putEntry(unsigned char *buf, const T& value, unsigned long width) const
+			{
+				unsigned long long bits;
+				if (std::numeric_limits<T>::is_integer) {
+					bits = (unsigned long long)value;
+				} else if (width == 4) {
+					float f = (float)value;
+					unsigned int u;
+					std::memcpy(&u, &f, 4);
+					bits = u;
+				} else {
+					double d = (double)value;
+					std::memcpy(&bits, &d, 8);
+				}
+				putBits(buf, bits, width);
+			}
+
+			template <class T>
+			void getEntry(const unsigned char *buf, T& value, unsigned long width) const
+			{
+				unsigned long long bits = getBits(buf, width);
+				if (std::numeric_limits<T>::is_integer) {
+					// Remarks: truncating the bits restores a signed entry's sign.
+					value = (T)bits;
+				} else if (width == 4) {
+					unsigned int u = (unsigned int)bits;
+					float f;
+					std::memcpy(&f, &u, 4);
+					value = (T)f;
+				} else {
+					double d;
+					std::memcpy(&d, &bits, 8);
+					value = (T)d;
+				}
+			}
+
+			// Encode an array of vectors of type V (a VectorN<T, N>, or derived from one) into
+			// the chunk buffer, a whole number of entries at a time.
+			template <class T, size_t N, class V>
+			void writeArray(DataSink& sink, const V *v, unsigned long count) const
+			{
+				unsigned char buf[CHUNK_SIZE];
+				unsigned long width = entrySize<T>();
+				unsigned long used = 0;
+				for (unsigned long k = 0; k < count; ++k) {
+					for (size_t i = 0; i < N; ++i) {
+						if (used + width > CHUNK_SIZE) {
+							sink.putBlock(buf, used);
+							used = 0;
+						}
+						putEntry(buf + used, v[k][i], width);
+						used += width;
+					}
+				}
+				if (used > 0) {
+					sink.putBlock(buf, used);
+				}
+			}
+
+			template <class T, size_t N, class V>
+			void readArray(DataSource& source, V *v, unsigned long count) const
+			{
+				unsigned char buf[CHUNK_SIZE];
+				unsigned long width = entrySize<T>();
+				unsigned long left = count * N; // entries still to be read
+				unsigned long used = 0;
+				unsigned long have = 0;
+				for (unsigned long k = 0; k < count; ++k) {
+					for (size_t i = 0; i < N; ++i) {
+						if (used == have) {
+							have = (CHUNK_SIZE / width < left ? CHUNK_SIZE / width : left) * width;
+							source.getBlock(buf, have);
+							used = 0;
+						}
+						getEntry(buf + used, v[k][i], width);
+						used += width;
+						--left;
+					}
+				}
+			}
+
+			// Internal state members.
+			ByteOrder mOrder;
+			RealFormat mReal;
+			//! @endcond
+	};
+}
+
+#endif
@@ -0,0 +1,25 @@
+#include "MonotonicTimer.h"
+using namespace metrobotics;
+
+MonotonicTimer::MonotonicTimer()
+{
+	// Initialize the reference point to the current time.
+	start();
+}
+
+void MonotonicTimer::start()
+{
+	mStart = now();
+	// Keep the inherited reference point (in seconds) in step.
+	_ref = mStart / 1e9;
+}
+
+double MonotonicTimer::elapsed() const
+{
+	return elapsedNs() / 1e9;
+}
+
+long long MonotonicTimer::elapsedNs() const
+{
+	return now() - mStart;
+}
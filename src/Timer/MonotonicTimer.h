@@ -0,0 +1,63 @@
+#ifndef METROBOTICS_MONOTONIC_TIMER_H
+#define METROBOTICS_MONOTONIC_TIMER_H
+
+#include "Timer.h"
+#include <ctime>
+
+namespace metrobotics
+{
+	/**
+	 * \class   MonotonicTimer
+	 *
+	 * \brief   A Timer that counts whole nanoseconds on the monotonic clock.
+	 *
+	 * \details Unlike PosixTimer, which reads the wall clock, this timer never jumps when the
+	 *          system's time is set (or stepped by NTP), and it keeps its reference point as an
+	 *          integer number of nanoseconds, so that its precision doesn't wear off with the
+	 *          magnitude of the time of day. elapsed() is still there (in seconds, as a double)
+	 *          for code written against Timer; elapsedNs() has the exact figure.
+	 *
+	 *          The clock is read with clock_gettime(CLOCK_MONOTONIC), which the C library
+	 *          serves from the vDSO, i.e. without entering the kernel.
+	 */
+	class MonotonicTimer : public Timer
+	{
+		public:
+			/**
+			 * \brief   Default constructor.
+			 *
+			 * \details Initializes the reference point to the time of object creation.
+			 */
+			MonotonicTimer();
+
+			// [Implement/override the interface that we inherited from Timer.]
+			void start();
+			double elapsed() const;
+
+			/**
+			 * \brief   Time (in nanoseconds) that has elapsed since the last start (or reset)
+			 *          of the timer.
+			 */
+			long long elapsedNs() const;
+
+			/**
+			 * \brief   The current time (in nanoseconds) on the monotonic clock.
+			 *
+			 * \details The clock starts at some unspecified point in the past (typically the
+			 *          system's boot), so only differences between readings are meaningful.
+			 */
+			static long long now()
+			{
+				// Remarks: defined here so that reading the clock costs no more than the read.
+				struct timespec ts;
+				clock_gettime(CLOCK_MONOTONIC, &ts);
+				return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+			}
+
+		private:
+			// Reference point (in nanoseconds on the monotonic clock).
+			long long mStart;
+	};
+}
+
+#endif
@@ -11,7 +11,9 @@ namespace metrobotics
 	 * \brief   POSIX implementation of the Timer interface.
 	 *
 	 * \details This implementation of the high resolution timer is able to count one-second
-	 *          intervals of time precise to the microsecond.
+	 *          intervals of time precise to the microsecond. It reads the wall clock, so the
+	 *          intervals it counts jump along with the system's time; see MonotonicTimer for
+	 *          a timer that doesn't.
 	 *
 	 * \author  Mark Manashirov <mark.manashirov@gmail.com>
 	 */
@@ -0,0 +1,260 @@
+#include "Profiler.h"
+#include "TscTimer.h"
+using namespace metrobotics;
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+using namespace std;
+
+#include <pthread.h>
+
+namespace
+{
+	// A node of a thread's call tree; node 0 is the root, which stands for the thread itself.
+	// Remarks: only the thread that owns the tree ever changes it, but anybody may read it at
+	// any time; a node is fully set up before it's linked into the tree (with a release store).
+	struct Node
+	{
+		const char *name;
+		atomic<unsigned int> firstChild;  // 0 means none
+		atomic<unsigned int> nextSibling; // 0 means none
+		atomic<unsigned long long> calls;
+		atomic<long long> inclusive; // in ticks
+		atomic<long long> exclusive; // in ticks
+	};
+
+	// A zone that is active.
+	struct Frame
+	{
+		unsigned int node;
+		long long start;    // in ticks
+		long long children; // ticks spent in the zones nested in it so far
+	};
+
+	// Add to a counter that nobody but the calling thread changes.
+	// Remarks: a plain load and store, which spares the hot path a locked instruction.
+	template <class T>
+	inline void add(atomic<T>& counter, T n)
+	{
+		counter.store(counter.load(memory_order_relaxed) + n, memory_order_relaxed);
+	}
+
+	// A thread's buffer.
+	struct ThreadLog
+	{
+		Node nodes[Profiler::MAX_NODES];
+		atomic<unsigned int> nNodes;
+		Frame stack[Profiler::MAX_DEPTH]; // stack[0] is the root
+		unsigned int depth;     // the number of frames on the stack
+		unsigned int skipped;   // the number of active zones that aren't being recorded
+		atomic<unsigned long long> dropped;
+		bool tsc;
+		string name;            // guarded by the registry's lock
+		ThreadLog *next;        // the next thread in the registry
+	};
+
+	// Calibrates the time stamp counter when it's constructed.
+	struct Calibration
+	{
+		Calibration()
+		{
+			TscTimer::calibration();
+		}
+	};
+}
+
+// The registry of every thread that has ever entered a zone, newest first.
+static pthread_mutex_t gLock = PTHREAD_MUTEX_INITIALIZER;
+static ThreadLog *gLogs = 0;
+static unsigned long gThreads = 0;
+
+// Remarks: the counter is calibrated while the program starts up (which takes some 20 ms),
+// rather than in the middle of the first zone that is entered.
+static Calibration gCalibration;
+
+// The calling thread's buffer.
+static ThreadLog *threadLog()
+{
+	// Remarks: a thread's log stays in the registry after the thread exits, so that its
+	// results can still be taken.
+	static thread_local ThreadLog *mine = 0;
+	if (mine == 0) {
+		ThreadLog *l = new ThreadLog;
+		Node& root = l->nodes[0];
+		root.name = 0;
+		root.firstChild = 0;
+		root.nextSibling = 0;
+		root.calls = 0;
+		root.inclusive = 0;
+		root.exclusive = 0;
+		l->nNodes = 1;
+		l->stack[0].node = 0;
+		l->stack[0].start = 0;
+		l->stack[0].children = 0;
+		l->depth = 1;
+		l->skipped = 0;
+		l->dropped = 0;
+		l->tsc = TscTimer::calibration().tsc;
+		pthread_mutex_lock(&gLock);
+		char name[32];
+		snprintf(name, sizeof(name), "thread %lu", ++gThreads);
+		l->name = name;
+		l->next = gLogs;
+		gLogs = l;
+		pthread_mutex_unlock(&gLock);
+		mine = l;
+	}
+	return mine;
+}
+
+void Profiler::enter(const char *name)
+{
+	ThreadLog *l = threadLog();
+	if (l->skipped > 0 || l->depth == MAX_DEPTH) {
+		++l->skipped;
+		add(l->dropped, 1ULL);
+		return;
+	}
+
+	// Find the zone among the children of the active one, or else add it.
+	unsigned int parent = l->stack[l->depth - 1].node;
+	unsigned int child = l->nodes[parent].firstChild.load(memory_order_relaxed);
+	while (child != 0 && l->nodes[child].name != name && strcmp(l->nodes[child].name, name) != 0) {
+		child = l->nodes[child].nextSibling.load(memory_order_relaxed);
+	}
+	if (child == 0) {
+		child = l->nNodes.load(memory_order_relaxed);
+		if (child == MAX_NODES) {
+			++l->skipped;
+			add(l->dropped, 1ULL);
+			return;
+		}
+		Node& n = l->nodes[child];
+		n.name = name;
+		n.firstChild.store(0, memory_order_relaxed);
+		n.nextSibling.store(l->nodes[parent].firstChild.load(memory_order_relaxed),
+		                    memory_order_relaxed);
+		n.calls.store(0, memory_order_relaxed);
+		n.inclusive.store(0, memory_order_relaxed);
+		n.exclusive.store(0, memory_order_relaxed);
+		l->nNodes.store(child + 1, memory_order_relaxed);
+		l->nodes[parent].firstChild.store(child, memory_order_release);
+	}
+
+	Frame& f = l->stack[l->depth++];
+	f.node = child;
+	f.children = 0;
+	// Remarks: the clock is read last, so that the bookkeeping above isn't counted.
+	f.start = TscTimer::ticks(l->tsc);
+}
+
+void Profiler::leave()
+{
+	ThreadLog *l = threadLog();
+	long long t = TscTimer::ticks(l->tsc);
+	if (l->skipped > 0) {
+		--l->skipped;
+		return;
+	} else if (l->depth <= 1) {
+		return;
+	}
+	const Frame& f = l->stack[--l->depth];
+	long long inclusive = t - f.start;
+	Node& n = l->nodes[f.node];
+	add(n.calls, 1ULL);
+	add(n.inclusive, inclusive);
+	add(n.exclusive, inclusive - f.children);
+	l->stack[l->depth - 1].children += inclusive;
+}
+
+void Profiler::threadName(const string& name)
+{
+	ThreadLog *l = threadLog();
+	pthread_mutex_lock(&gLock);
+	l->name = name;
+	pthread_mutex_unlock(&gLock);
+}
+
+// Collect the results of a node's subtree (but not of the node itself) in depth-first order.
+static void collect(const Node *nodes, unsigned int node, unsigned int depth, double nsPerTick,
+                    const string& thread, vector<Profiler::Zone>& zones)
+{
+	// Remarks: children are linked newest first; the results list them oldest first.
+	vector<unsigned int> children;
+	unsigned int child = nodes[node].firstChild.load(memory_order_acquire);
+	while (child != 0) {
+		children.push_back(child);
+		child = nodes[child].nextSibling.load(memory_order_relaxed);
+	}
+	reverse(children.begin(), children.end());
+	for (unsigned long i = 0; i < children.size(); ++i) {
+		const Node& n = nodes[children[i]];
+		Profiler::Zone z;
+		z.thread = thread;
+		z.name = n.name;
+		z.depth = depth;
+		z.calls = n.calls.load(memory_order_relaxed);
+		z.inclusive = (long long)(n.inclusive.load(memory_order_relaxed) * nsPerTick);
+		z.exclusive = (long long)(n.exclusive.load(memory_order_relaxed) * nsPerTick);
+		zones.push_back(z);
+		collect(nodes, children[i], depth + 1, nsPerTick, thread, zones);
+	}
+}
+
+vector<Profiler::Zone> Profiler::zones()
+{
+	vector<ThreadLog *> logs;
+	vector<Zone> zones;
+	pthread_mutex_lock(&gLock);
+	for (ThreadLog *l = gLogs; l != 0; l = l->next) {
+		logs.push_back(l);
+	}
+	// List the threads in the order in which they first entered a zone.
+	for (unsigned long i = logs.size(); i-- > 0; ) {
+		ThreadLog *l = logs[i];
+		double nsPerTick = l->tsc ? TscTimer::calibration().nsPerTick : 1.0;
+		collect(l->nodes, 0, 0, nsPerTick, l->name, zones);
+	}
+	pthread_mutex_unlock(&gLock);
+	return zones;
+}
+
+void Profiler::report(ostream& out)
+{
+	vector<Zone> z = zones();
+	char line[160];
+	string thread;
+	for (unsigned long i = 0; i < z.size(); ++i) {
+		if (i == 0 || z[i].thread != thread) {
+			thread = z[i].thread;
+			snprintf(line, sizeof(line), "%-40s %12s %14s %14s %12s\n", thread.c_str(), "calls",
+			         "inclusive ms", "exclusive ms", "average us");
+			out << (i == 0 ? "" : "\n") << line;
+		}
+		string name = string(2 * (z[i].depth + 1), ' ') + z[i].name;
+		if (name.size() > 40) {
+			name.resize(40);
+		}
+		snprintf(line, sizeof(line), "%-40s %12llu %14.3f %14.3f %12.3f\n", name.c_str(),
+		         z[i].calls, z[i].inclusive / 1e6, z[i].exclusive / 1e6,
+		         z[i].calls > 0 ? z[i].inclusive / 1e3 / z[i].calls : 0.0);
+		out << line;
+	}
+	unsigned long long d = dropped();
+	if (d > 0) {
+		out << "(" << d << " zones weren't recorded)\n";
+	}
+}
+
+unsigned long long Profiler::dropped()
+{
+	unsigned long long d = 0;
+	pthread_mutex_lock(&gLock);
+	for (ThreadLog *l = gLogs; l != 0; l = l->next) {
+		d += l->dropped.load(memory_order_relaxed);
+	}
+	pthread_mutex_unlock(&gLock);
+	return d;
+}
@@ -0,0 +1,133 @@
+#ifndef METROBOTICS_PROFILER_H
+#define METROBOTICS_PROFILER_H
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace metrobotics
+{
+	/**
+	 * \class   Profiler
+	 *
+	 * \brief   Measures where the time goes, zone by zone.
+	 *
+	 * \details A zone is a stretch of code that is marked with PROFILE_SCOPE() (or a whole
+	 *          function, marked with PROFILE_FUNCTION()); zones that are entered while another
+	 *          one is active are nested in it, so each thread builds up a call tree of zones.
+	 *          For every node of that tree, the profiler counts the calls, the inclusive time
+	 *          (all of the time spent in the zone) and the exclusive time (the time spent in the
+	 *          zone itself, rather than in the zones nested in it). The same zone that is entered
+	 *          from different places makes up separate nodes.
+	 *
+	 *          Each thread records into a buffer of its own, without any locks or atomic
+	 *          read-modify-write operations: a zone costs two readings of the time stamp counter
+	 *          (see TscTimer) and a handful of plain stores. The results may be taken (with
+	 *          zones() or report()) at any time, from any thread; they cover every thread that
+	 *          has entered a zone so far, including the ones that have since exited.
+	 *
+	 *          The markers are compiled out entirely unless METROBOTICS_PROFILING is defined
+	 *          (e.g. with -DMETROBOTICS_PROFILING), so they may well stay in the code for good.
+	 *          A program that uses the profiler calibrates the time stamp counter while it
+	 *          starts up, which takes some 20 ms.
+	 *
+	 * \warning Zone names are kept by address, so they must outlive the profiler (string
+	 *          literals and __func__ do). Each thread records up to MAX_NODES distinct nodes,
+	 *          nested up to MAX_DEPTH deep; zones beyond that aren't recorded (see dropped()).
+	 *          A thread's buffer takes up some 42 KB, which is never freed (not even once the
+	 *          thread exits), so a program that keeps starting new threads that enter zones
+	 *          keeps growing.
+	 */
+	class Profiler
+	{
+		public:
+			enum { MAX_NODES = 1024, MAX_DEPTH = 64 };
+
+			/**
+			 * \brief   Marks a zone for as long as it exists.
+			 */
+			class Scope
+			{
+				public:
+					explicit Scope(const char *name)
+					{
+						Profiler::enter(name);
+					}
+
+					~Scope()
+					{
+						Profiler::leave();
+					}
+
+				private:
+					// Disable copying and assignment for Scope objects.
+					Scope(const Scope&);
+					Scope& operator=(const Scope&);
+			};
+
+			/**
+			 * \brief   The results for one node of a thread's call tree.
+			 */
+			struct Zone
+			{
+				std::string thread;
+				const char *name;
+				unsigned int depth;  // 0 for the outermost zones
+				unsigned long long calls;
+				long long inclusive; // in nanoseconds
+				long long exclusive; // in nanoseconds
+			};
+
+			/**
+			 * \brief   Enter (or leave) a zone on the calling thread.
+			 *
+			 * \details Scope (and thus PROFILE_SCOPE()) does that on its own; calls to leave()
+			 *          must match the calls to enter().
+			 */
+			static void enter(const char *name);
+			static void leave();
+
+			/**
+			 * \brief   Give the calling thread a name to show in the results.
+			 *
+			 * \details Threads are otherwise named by the order in which they first entered a
+			 *          zone.
+			 */
+			static void threadName(const std::string& name);
+
+			/**
+			 * \brief   Take the results so far, thread by thread, each thread's call tree in
+			 *          depth-first order.
+			 *
+			 * \details Zones that are active at the time aren't counted until they're left.
+			 */
+			static std::vector<Zone> zones();
+
+			/**
+			 * \brief   Write the results so far as a table, with nested zones indented.
+			 */
+			static void report(std::ostream& out);
+
+			/**
+			 * \brief   The number of zones that weren't recorded for lack of room.
+			 */
+			static unsigned long long dropped();
+
+		private:
+			// Disable construction.
+			Profiler();
+	};
+}
+
+// [Markers.]
+#ifdef METROBOTICS_PROFILING
+#define PROFILE_JOIN2(a, b) a##b
+#define PROFILE_JOIN(a, b) PROFILE_JOIN2(a, b)
+#define PROFILE_SCOPE(name) metrobotics::Profiler::Scope PROFILE_JOIN(profilerScope, __LINE__)(name)
+#define PROFILE_FUNCTION() PROFILE_SCOPE(__func__)
+#else
+#define PROFILE_SCOPE(name) ((void)0)
+#define PROFILE_FUNCTION() ((void)0)
+#endif
+
+#endif
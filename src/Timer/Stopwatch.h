@@ -0,0 +1,170 @@
+#ifndef METROBOTICS_STOPWATCH_H
+#define METROBOTICS_STOPWATCH_H
+
+#include "MonotonicTimer.h"
+#include "TscTimer.h"
+#include <ctime>
+
+namespace metrobotics
+{
+	// [Clock policies for Stopwatch.]
+	// Remarks: a clock policy reads its clock with read(), in ticks of its own, and converts a
+	// number of ticks into nanoseconds with toNs(); both must be cheap enough to be inlined.
+
+	/**
+	 * \brief   The monotonic clock (see MonotonicTimer); ticks are nanoseconds.
+	 */
+	struct MonotonicClock
+	{
+		static long long read()
+		{
+			return MonotonicTimer::now();
+		}
+
+		static long long toNs(long long ticks)
+		{
+			return ticks;
+		}
+	};
+
+	/**
+	 * \brief   The time stamp counter (see TscTimer), or the monotonic clock where it isn't
+	 *          usable.
+	 */
+	struct TscClock
+	{
+		TscClock()
+		:tsc(TscTimer::calibration().tsc),
+		 nsPerTick(TscTimer::calibration().nsPerTick)
+		{
+		}
+
+		long long read() const
+		{
+			return (long long)TscTimer::ticks(tsc);
+		}
+
+		long long toNs(long long ticks) const
+		{
+			return (long long)(ticks * nsPerTick);
+		}
+
+		bool tsc;
+		double nsPerTick;
+	};
+
+	/**
+	 * \brief   The coarse monotonic clock; ticks are nanoseconds.
+	 *
+	 * \details The cheapest clock to read, but it only advances once per scheduler tick
+	 *          (typically every 1 to 4 milliseconds).
+	 */
+	struct CoarseClock
+	{
+		static long long read()
+		{
+#ifdef CLOCK_MONOTONIC_COARSE
+			struct timespec ts;
+			clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+			return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+#else
+			return MonotonicTimer::now();
+#endif
+		}
+
+		static long long toNs(long long ticks)
+		{
+			return ticks;
+		}
+	};
+
+	/**
+	 * \class   Stopwatch
+	 *
+	 * \brief   A timer whose clock is chosen at compile time.
+	 *
+	 * \details Unlike a Timer, a stopwatch has no virtual functions: its clock is a template
+	 *          parameter (MonotonicClock, TscClock or CoarseClock, or any class with the same
+	 *          members), so that taking a reading compiles down to an inlined read of the clock
+	 *          and a subtraction. Use a Timer where the clock has to be chosen at run time.
+	 *
+	 *          Besides the time since it was started, a stopwatch keeps track of laps: lap()
+	 *          tells the time since the previous lap (or since the start), and starts the next
+	 *          one. Times are reported in nanoseconds; the \c Ticks variants report the clock's
+	 *          own ticks, and leave the conversion (see clock()) until later.
+	 */
+	template <class Clock = MonotonicClock>
+	class Stopwatch
+	{
+		public:
+			/**
+			 * \brief   Default constructor; starts the stopwatch.
+			 */
+			Stopwatch()
+			{
+				start();
+			}
+
+			/**
+			 * \brief   Start (or restart) the stopwatch, along with its first lap.
+			 */
+			void start()
+			{
+				mStart = mLap = mClock.read();
+			}
+
+			/**
+			 * \brief   Time (in nanoseconds) since the start, without disturbing the lap.
+			 */
+			long long split() const
+			{
+				return mClock.toNs(splitTicks());
+			}
+
+			long long splitTicks() const
+			{
+				return mClock.read() - mStart;
+			}
+
+			/**
+			 * \brief   Time (in nanoseconds) since the previous lap (or the start); the next
+			 *          lap starts right away.
+			 */
+			long long lap()
+			{
+				return mClock.toNs(lapTicks());
+			}
+
+			long long lapTicks()
+			{
+				long long t = mClock.read();
+				long long ticks = t - mLap;
+				mLap = t;
+				return ticks;
+			}
+
+			/**
+			 * \brief   Time (in seconds) since the start, as a Timer would tell it.
+			 */
+			double elapsed() const
+			{
+				return split() / 1e9;
+			}
+
+			/**
+			 * \brief   The stopwatch's clock.
+			 */
+			const Clock& clock() const
+			{
+				return mClock;
+			}
+
+		private:
+			// Internal state members.
+			Clock mClock;
+			long long mStart; // in ticks
+			long long mLap;
+	};
+}
+
+#endif
@@ -13,6 +13,8 @@ namespace metrobotics
 	 *          interval in seconds. Furthermore, the goal is to be able to represent this interval
 	 *          with a precision that is greater than just one second. However, because this is an
 	 *          abstract class, the precision of the timer will depend on the specific implementation.
+	 *          Where the implementation can be chosen at compile time, a Stopwatch avoids the cost
+	 *          of the virtual calls.
 	 *
 	 * \author  Mark Manashirov <mark.manashirov@gmail.com>
 	 */
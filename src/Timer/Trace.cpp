@@ -0,0 +1,326 @@
+#include "Trace.h"
+#include "TscTimer.h"
+using namespace metrobotics;
+
+#include <atomic>
+#include <cstdio>
+#include <vector>
+using namespace std;
+
+#include <pthread.h>
+#include <unistd.h>
+
+namespace
+{
+	// A slot of a thread's ring.
+	// Remarks: the thread that owns the ring overwrites its slots while others may be copying
+	// them; seq is the number of the event in the slot plus one, or 0 while the slot is being
+	// written, so a copy that was taken while the slot changed can be told apart (and dropped).
+	struct Slot
+	{
+		atomic<unsigned long long> seq;
+		atomic<long long> time; // in ticks
+		atomic<const char *> name;
+		atomic<const char *> category;
+		atomic<double> value;
+		atomic<char> phase;
+	};
+
+	// A thread's ring.
+	struct ThreadRing
+	{
+		Slot slots[Trace::CAPACITY];
+		atomic<unsigned long long> written; // the number of events recorded so far
+		bool tsc;
+		unsigned long id;
+		string name;      // guarded by the registry's lock
+		ThreadRing *next; // the next thread in the registry
+	};
+
+	// An event, as copied out of a ring.
+	struct Event
+	{
+		long long time;
+		const char *name;
+		const char *category;
+		double value;
+		char phase;
+	};
+
+	// The events of one thread, oldest first.
+	struct ThreadEvents
+	{
+		unsigned long id;
+		string name;
+		double nsPerTick;
+		vector<Event> events;
+	};
+
+	// Calibrates the time stamp counter on construction.
+	struct Calibration
+	{
+		Calibration()
+		{
+			TscTimer::calibration();
+		}
+	};
+
+	// What a background dump writes.
+	struct Snapshot
+	{
+		string path;
+		vector<ThreadEvents> threads;
+	};
+}
+
+// The registry of every thread that has ever recorded an event, newest first.
+static pthread_mutex_t gLock = PTHREAD_MUTEX_INITIALIZER;
+static ThreadRing *gRings = 0;
+static unsigned long gThreads = 0;
+
+// Background dumps that are still being written, and those that couldn't be.
+static pthread_mutex_t gDumpLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t gDumpDone = PTHREAD_COND_INITIALIZER;
+static unsigned long gDumps = 0;
+static unsigned long gDumpFailures = 0;
+
+// Calibrate up front: the first event that a program records is as likely as any to be the one
+// that matters, and calibrating holds the caller up for some 20 ms.
+static Calibration gCalibration;
+
+// The calling thread's ring.
+static ThreadRing *threadRing()
+{
+	// Remarks: a thread's ring stays in the registry after the thread exits, so that its last
+	// events still show up in the dumps.
+	static thread_local ThreadRing *mine = 0;
+	if (mine == 0) {
+		ThreadRing *r = new ThreadRing();
+		r->tsc = TscTimer::calibration().tsc;
+		pthread_mutex_lock(&gLock);
+		r->id = ++gThreads;
+		char name[32];
+		snprintf(name, sizeof(name), "thread %lu", r->id);
+		r->name = name;
+		r->next = gRings;
+		gRings = r;
+		pthread_mutex_unlock(&gLock);
+		mine = r;
+	}
+	return mine;
+}
+
+// Record an event on the calling thread.
+static void record(char phase, const char *name, const char *category, double value)
+{
+	ThreadRing *r = threadRing();
+	long long t = TscTimer::ticks(r->tsc);
+	unsigned long long i = r->written.load(memory_order_relaxed);
+	Slot& s = r->slots[i % Trace::CAPACITY];
+	s.seq.store(0, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	s.time.store(t, memory_order_relaxed);
+	s.name.store(name, memory_order_relaxed);
+	s.category.store(category, memory_order_relaxed);
+	s.value.store(value, memory_order_relaxed);
+	s.phase.store(phase, memory_order_relaxed);
+	s.seq.store(i + 1, memory_order_release);
+	r->written.store(i + 1, memory_order_release);
+}
+
+// Copy every thread's recent events (in the order in which the threads first recorded any).
+static void snapshot(vector<ThreadEvents>& threads)
+{
+	double nsPerTick = TscTimer::calibration().nsPerTick;
+	pthread_mutex_lock(&gLock);
+	for (ThreadRing *r = gRings; r != 0; r = r->next) {
+		threads.insert(threads.begin(), ThreadEvents());
+		ThreadEvents& te = threads.front();
+		te.id = r->id;
+		te.name = r->name;
+		te.nsPerTick = r->tsc ? nsPerTick : 1.0;
+		unsigned long long end = r->written.load(memory_order_acquire);
+		unsigned long long i = end > Trace::CAPACITY ? end - Trace::CAPACITY : 0;
+		te.events.reserve(end - i);
+		for (; i < end; ++i) {
+			const Slot& s = r->slots[i % Trace::CAPACITY];
+			Event e;
+			unsigned long long before = s.seq.load(memory_order_acquire);
+			e.time = s.time.load(memory_order_relaxed);
+			e.name = s.name.load(memory_order_relaxed);
+			e.category = s.category.load(memory_order_relaxed);
+			e.value = s.value.load(memory_order_relaxed);
+			e.phase = s.phase.load(memory_order_relaxed);
+			atomic_thread_fence(memory_order_acquire);
+			if (before == i + 1 && s.seq.load(memory_order_relaxed) == i + 1) {
+				te.events.push_back(e);
+			}
+		}
+	}
+	pthread_mutex_unlock(&gLock);
+}
+
+// Write a string as a JSON string literal.
+static void putString(FILE *f, const char *s)
+{
+	fputc('"', f);
+	for (; *s != '\0'; ++s) {
+		unsigned char c = *s;
+		if (c == '"' || c == '\\') {
+			fputc('\\', f);
+			fputc(c, f);
+		} else if (c < 0x20) {
+			fprintf(f, "\\u%04x", c);
+		} else {
+			fputc(c, f);
+		}
+	}
+	fputc('"', f);
+}
+
+// Write a snapshot in the Chrome trace-event format.
+static bool writeEvents(const vector<ThreadEvents>& threads, const string& path)
+{
+	FILE *f = fopen(path.c_str(), "w");
+	if (f == 0) {
+		return false;
+	}
+	// Remarks: times are written relative to the oldest event, in microseconds.
+	double origin = 0.0;
+	bool first = true;
+	for (unsigned long k = 0; k < threads.size(); ++k) {
+		if (!threads[k].events.empty()) {
+			double t = threads[k].events[0].time * threads[k].nsPerTick;
+			if (first || t < origin) {
+				origin = t;
+				first = false;
+			}
+		}
+	}
+
+	int pid = getpid();
+	fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n", f);
+	first = true;
+	for (unsigned long k = 0; k < threads.size(); ++k) {
+		const ThreadEvents& te = threads[k];
+		fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%lu,"
+		        "\"args\":{\"name\":", first ? "" : ",\n", pid, te.id);
+		putString(f, te.name.c_str());
+		fputs("}}", f);
+		first = false;
+		// Remarks: the spans whose beginnings have been overwritten are left out altogether.
+		unsigned long depth = 0;
+		for (unsigned long i = 0; i < te.events.size(); ++i) {
+			const Event& e = te.events[i];
+			if (e.phase == 'E') {
+				if (depth == 0) {
+					continue;
+				}
+				--depth;
+			} else if (e.phase == 'B') {
+				++depth;
+			}
+			fprintf(f, ",\n{\"ph\":\"%c\",\"ts\":%.3f,\"pid\":%d,\"tid\":%lu", e.phase,
+			        (e.time * te.nsPerTick - origin) / 1000.0, pid, te.id);
+			if (e.name != 0) {
+				fputs(",\"name\":", f);
+				putString(f, e.name);
+			}
+			if (e.category != 0) {
+				fputs(",\"cat\":", f);
+				putString(f, e.category);
+			}
+			if (e.phase == 'i') {
+				fputs(",\"s\":\"t\"", f);
+			} else if (e.phase == 'C') {
+				fprintf(f, ",\"args\":{\"value\":%.9g}", e.value);
+			}
+			fputc('}', f);
+		}
+	}
+	fputs("\n]}\n", f);
+	bool ok = !ferror(f);
+	return fclose(f) == 0 && ok;
+}
+
+// Write a snapshot in the background.
+static void *writeSnapshot(void *arg)
+{
+	Snapshot *s = static_cast<Snapshot *>(arg);
+	bool ok = writeEvents(s->threads, s->path);
+	delete s;
+	pthread_mutex_lock(&gDumpLock);
+	if (!ok) {
+		++gDumpFailures;
+	}
+	if (--gDumps == 0) {
+		pthread_cond_broadcast(&gDumpDone);
+	}
+	pthread_mutex_unlock(&gDumpLock);
+	return 0;
+}
+
+void Trace::begin(const char *name, const char *category)
+{
+	record('B', name, category, 0.0);
+}
+
+void Trace::end()
+{
+	record('E', 0, 0, 0.0);
+}
+
+void Trace::instant(const char *name, const char *category)
+{
+	record('i', name, category, 0.0);
+}
+
+void Trace::counter(const char *name, double value)
+{
+	record('C', name, 0, value);
+}
+
+void Trace::threadName(const string& name)
+{
+	ThreadRing *r = threadRing();
+	pthread_mutex_lock(&gLock);
+	r->name = name;
+	pthread_mutex_unlock(&gLock);
+}
+
+bool Trace::dump(const string& path)
+{
+	vector<ThreadEvents> threads;
+	snapshot(threads);
+	return writeEvents(threads, path);
+}
+
+void Trace::dumpInBackground(const string& path)
+{
+	Snapshot *s = new Snapshot;
+	s->path = path;
+	snapshot(s->threads);
+	pthread_mutex_lock(&gDumpLock);
+	++gDumps;
+	pthread_mutex_unlock(&gDumpLock);
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	pthread_t thread;
+	if (pthread_create(&thread, &attr, writeSnapshot, s) != 0) {
+		writeSnapshot(s);
+	}
+	pthread_attr_destroy(&attr);
+}
+
+bool Trace::waitForDumps()
+{
+	pthread_mutex_lock(&gDumpLock);
+	while (gDumps > 0) {
+		pthread_cond_wait(&gDumpDone, &gDumpLock);
+	}
+	bool ok = gDumpFailures == 0;
+	gDumpFailures = 0;
+	pthread_mutex_unlock(&gDumpLock);
+	return ok;
+}
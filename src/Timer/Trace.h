@@ -0,0 +1,134 @@
+#ifndef METROBOTICS_TRACE_H
+#define METROBOTICS_TRACE_H
+
+#include <string>
+
+namespace metrobotics
+{
+	/**
+	 * \class   Trace
+	 *
+	 * \brief   Records a timeline of what each thread was doing, for a trace viewer.
+	 *
+	 * \details Spans (with a beginning and an end), instants and counter values are recorded
+	 *          into a ring of the most recent CAPACITY events per thread, like a flight
+	 *          recorder: once a thread's ring is full, its oldest events make room for new ones.
+	 *          Recording an event costs a reading of the time stamp counter (see TscTimer) and a
+	 *          few plain stores into the ring, without any locks; nothing is formatted until the
+	 *          rings are dumped.
+	 *
+	 *          dump() writes every thread's events in the Chrome trace-event format (JSON), which
+	 *          chrome://tracing, Perfetto (ui.perfetto.dev) and the like can open. When something
+	 *          goes wrong (e.g. a control cycle overruns), dumpInBackground() takes a snapshot of
+	 *          the rings right away, and leaves the formatting and the writing to a thread of its
+	 *          own, so that the thread that noticed the problem can carry on.
+	 *
+	 *          The markers (TRACE_SCOPE(), TRACE_FUNCTION(), TRACE_INSTANT() and TRACE_COUNTER())
+	 *          are compiled out entirely unless METROBOTICS_TRACING is defined. A program that
+	 *          uses the trace calibrates the time stamp counter while it starts up (some 20 ms).
+	 *
+	 * \warning Names and categories are kept by address, so they must outlive the trace (string
+	 *          literals and __func__ do). Spans must be ended on the thread that began them.
+	 *          A thread's ring takes up some 400 KB (CAPACITY slots of 48 bytes), which is never
+	 *          freed (not even once the thread exits), so a program that keeps starting new
+	 *          threads that record events keeps growing.
+	 */
+	class Trace
+	{
+		public:
+			enum { CAPACITY = 8192 };
+
+			/**
+			 * \brief   Marks a span for as long as it exists.
+			 */
+			class Span
+			{
+				public:
+					explicit Span(const char *name, const char *category = 0)
+					{
+						Trace::begin(name, category);
+					}
+
+					~Span()
+					{
+						Trace::end();
+					}
+
+				private:
+					// Disable copying and assignment for Span objects.
+					Span(const Span&);
+					Span& operator=(const Span&);
+			};
+
+			/**
+			 * \brief   Begin (or end) a span on the calling thread.
+			 *
+			 * \details end() ends the span that was begun last.
+			 */
+			static void begin(const char *name, const char *category = 0);
+			static void end();
+
+			/**
+			 * \brief   Record an instant on the calling thread.
+			 */
+			static void instant(const char *name, const char *category = 0);
+
+			/**
+			 * \brief   Record the value of a counter (which viewers plot over time).
+			 */
+			static void counter(const char *name, double value);
+
+			/**
+			 * \brief   Give the calling thread a name to show in the viewer.
+			 */
+			static void threadName(const std::string& name);
+
+			/**
+			 * \brief   Write every thread's recent events into a file.
+			 *
+			 * \details Events that are recorded while the rings are being copied may or may
+			 *          not make it into the file.
+			 *
+			 * \returns false if the file couldn't be written
+			 */
+			static bool dump(const std::string& path);
+
+			/**
+			 * \brief   Take a snapshot of every thread's recent events, and write it into a
+			 *          file on a thread of its own.
+			 *
+			 * \details Falls back to writing the file right away if no thread can be started.
+			 */
+			static void dumpInBackground(const std::string& path);
+
+			/**
+			 * \brief   Wait until all of the files that are being written in the background
+			 *          are complete.
+			 *
+			 * \returns false if any of the files that have been written in the background
+			 *          since the last call couldn't be written
+			 */
+			static bool waitForDumps();
+
+		private:
+			// Disable construction.
+			Trace();
+	};
+}
+
+// [Markers.]
+#ifdef METROBOTICS_TRACING
+#define TRACE_JOIN2(a, b) a##b
+#define TRACE_JOIN(a, b) TRACE_JOIN2(a, b)
+#define TRACE_SCOPE(...) metrobotics::Trace::Span TRACE_JOIN(traceSpan, __LINE__)(__VA_ARGS__)
+#define TRACE_FUNCTION() TRACE_SCOPE(__func__)
+#define TRACE_INSTANT(...) metrobotics::Trace::instant(__VA_ARGS__)
+#define TRACE_COUNTER(name, value) metrobotics::Trace::counter(name, value)
+#else
+#define TRACE_SCOPE(...) ((void)0)
+#define TRACE_FUNCTION() ((void)0)
+#define TRACE_INSTANT(...) ((void)0)
+#define TRACE_COUNTER(name, value) ((void)0)
+#endif
+
+#endif
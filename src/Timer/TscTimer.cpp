@@ -0,0 +1,72 @@
+#include "TscTimer.h"
+using namespace metrobotics;
+
+#include <ctime>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+// How long (in nanoseconds) to count the ticks of the counter for when calibrating it.
+static const long CALIBRATION_TIME = 20000000L;
+
+// Read the counter along with the monotonic clock, which is read on both sides of it.
+static void sample(unsigned long long& tick, long long& ns)
+{
+	long long before = MonotonicTimer::now();
+	tick = TscTimer::ticks(true);
+	long long after = MonotonicTimer::now();
+	ns = before + (after - before) / 2;
+}
+
+// Measure the rate of the counter, or settle for the monotonic clock.
+static TscTimer::Calibration calibrate()
+{
+	TscTimer::Calibration c;
+	c.tsc = false;
+	c.ticksPerNs = 1.0;
+	c.nsPerTick = 1.0;
+	if (!TscTimer::invariant()) {
+		return c;
+	}
+	unsigned long long t0, t1;
+	long long n0, n1;
+	sample(t0, n0);
+	// Remarks: however long the sleep actually takes, both readings cover the same interval.
+	struct timespec ts = { 0, CALIBRATION_TIME };
+	nanosleep(&ts, 0);
+	sample(t1, n1);
+	if (t1 <= t0 || n1 <= n0) {
+		return c;
+	}
+	c.tsc = true;
+	c.ticksPerNs = (double)(t1 - t0) / (n1 - n0);
+	c.nsPerTick = 1.0 / c.ticksPerNs;
+	return c;
+}
+
+TscTimer::TscTimer()
+:mTsc(calibration().tsc),
+ mNsPerTick(calibration().nsPerTick)
+{
+	// Initialize the reference point to the current time.
+	start();
+}
+
+bool TscTimer::invariant()
+{
+#if defined(__x86_64__) || defined(__i386__)
+	// Remarks: __get_cpuid() fails if the CPU doesn't have the leaf at all.
+	unsigned int eax, ebx, ecx, edx;
+	if (__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx)) {
+		return (edx & (1U << 8)) != 0;
+	}
+#endif
+	return false;
+}
+
+const TscTimer::Calibration& TscTimer::calibration()
+{
+	// Remarks: initialized exactly once, even if several threads get here at the same time.
+	static const Calibration c = calibrate();
+	return c;
+}
@@ -0,0 +1,134 @@
+#ifndef METROBOTICS_TSC_TIMER_H
+#define METROBOTICS_TSC_TIMER_H
+
+#include "Timer.h"
+#include "MonotonicTimer.h"
+
+namespace metrobotics
+{
+	/**
+	 * \class   TscTimer
+	 *
+	 * \brief   A Timer that counts CPU cycles, for timing very short stretches of code.
+	 *
+	 * \details Reading the time stamp counter takes a single instruction (some ten to twenty
+	 *          nanoseconds, without entering the kernel or even the C library), which makes this
+	 *          timer cheap enough for inner loops. The counter's rate is calibrated against the
+	 *          monotonic clock once per process (which takes about 20 milliseconds, when the
+	 *          first timer is constructed), and the cycles are converted to time with it.
+	 *
+	 *          The counter is only usable as a clock if it's invariant, i.e. if it ticks at a
+	 *          constant rate no matter the core's frequency or sleep state, and in step on all
+	 *          cores. Where it isn't (or where there's no such counter, on non-x86 machines), the
+	 *          timer falls back to the monotonic clock (see MonotonicTimer), which is slower to
+	 *          read but just as correct; usesTsc() tells which one is in use.
+	 *
+	 * \warning The counter is read without serializing the instruction stream, so the CPU may
+	 *          move a reading by a few dozen cycles relative to the code around it; intervals
+	 *          that short are beyond any timer anyway.
+	 */
+	class TscTimer : public Timer
+	{
+		public:
+			/**
+			 * \brief   The result of calibrating the counter.
+			 */
+			struct Calibration
+			{
+				bool tsc;            // whether the time stamp counter is in use
+				double ticksPerNs;   // its rate (exactly 1 when falling back)
+				double nsPerTick;
+			};
+
+			/**
+			 * \brief   Default constructor.
+			 *
+			 * \details Initializes the reference point to the time of object creation (and
+			 *          calibrates the counter, if that hasn't been done yet).
+			 */
+			TscTimer();
+
+			// [Implement/override the interface that we inherited from Timer.]
+			// Remarks: defined here, so that the compiler can inline the calls wherever it knows
+			// the type of the timer.
+			void start()
+			{
+				mStart = read();
+				_ref = mStart * mNsPerTick / 1e9;
+			}
+
+			double elapsed() const
+			{
+				return (read() - mStart) * mNsPerTick / 1e9;
+			}
+
+			/**
+			 * \brief   Time (in nanoseconds) that has elapsed since the last start (or reset)
+			 *          of the timer.
+			 */
+			long long elapsedNs() const
+			{
+				return (long long)((read() - mStart) * mNsPerTick);
+			}
+
+			/**
+			 * \brief   Ticks that have elapsed since the last start (or reset) of the timer.
+			 *
+			 * \details Cheaper still than elapsedNs(); see calibration() for the rate.
+			 */
+			unsigned long long elapsedTicks() const
+			{
+				return read() - mStart;
+			}
+
+			/**
+			 * \brief   Whether the timer counts with the time stamp counter (rather than the
+			 *          monotonic clock).
+			 */
+			bool usesTsc() const
+			{
+				return mTsc;
+			}
+
+			/**
+			 * \brief   Determine whether the CPU has an invariant time stamp counter.
+			 */
+			static bool invariant();
+
+			/**
+			 * \brief   Calibrate the counter (once per process) and tell the result.
+			 *
+			 * \details Safe to call from any thread.
+			 */
+			static const Calibration& calibration();
+
+			/**
+			 * \brief   The time stamp counter itself (or the monotonic clock, in nanoseconds,
+			 *          when falling back).
+			 */
+			static unsigned long long ticks(bool tsc)
+			{
+#if defined(__x86_64__) || defined(__i386__)
+				if (tsc) {
+					return __builtin_ia32_rdtsc();
+				}
+#endif
+				return MonotonicTimer::now();
+			}
+
+		private:
+			unsigned long long read() const
+			{
+				return ticks(mTsc);
+			}
+
+			// Internal state members.
+			// Remarks: the calibration is copied into each timer, which spares the reads a
+			// check for whether it has been done.
+			bool mTsc;
+			double mNsPerTick;
+			unsigned long long mStart; // in ticks
+	};
+}
+
+#endif
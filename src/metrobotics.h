@@ -42,7 +42,7 @@
  *       <li>
  *         Link the \em libMetrobotics.a library file into your project.
  *             \code
- *                 g++ foo.cpp -IMetroUtil/include -LMetroUtil/lib -lMetrobotics
+ *                 g++ foo.cpp -IMetroUtil/include -LMetroUtil/lib -lMetrobotics -pthread
  *             \endcode
  *       </li>
  *     </ol>
@@ -79,7 +79,18 @@
 
 // [Simply include everything!]
 #include "Communication/Serial.h"
+#include "Communication/SerialConfig.h"
 #include "Communication/PosixSerial.h"
+#include "Communication/ByteRing.h"
+#include "Communication/Reactor.h"
+#include "Communication/PacketCodec.h"
+#include "Communication/SerialRecorder.h"
+#include "Communication/ReplaySerial.h"
+#include "Communication/SharedSerial.h"
+#include "Communication/WireFormat.h"
+#include "Communication/AsyncSerial.h"
+#include "Communication/Pipeline.h"
+#include "Communication/OutputScheduler.h"
 #include "Math/RealPredicate.h"
 #include "Math/RealEquality.h"
 #include "Math/RealLessThan.h"
@@ -88,6 +99,11 @@
 #include "Math/Lerp.h"
 #include "Timer/Timer.h"
 #include "Timer/PosixTimer.h"
+#include "Timer/MonotonicTimer.h"
+#include "Timer/TscTimer.h"
+#include "Timer/Stopwatch.h"
+#include "Timer/Profiler.h"
+#include "Timer/Trace.h"
 
 /**
  * \namespace  metrobotics
@@ -0,0 +1,189 @@
+/**
+ * \file    "AsyncInputTest.cpp"
+ *
+ * \brief   Tests for PosixSerial's asynchronous input: the hand-off from the reader thread
+ *          through the ring, and the timestamps that travel along with it.
+ *
+ * \details The port is the slave end of a pseudo-terminal; a thread writes into the master end.
+ */
+#include "Communication/PosixSerial.h"
+#include "Timer/MonotonicTimer.h"
+#include "Check.h"
+using namespace metrobotics;
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <termios.h>
+
+// The byte at the given position of the test stream.
+static unsigned char streamByte(unsigned long position)
+{
+	return (unsigned char)(position * 7 + position / 251);
+}
+
+// What the writer thread writes into the master end of the pseudo-terminal.
+struct Feed
+{
+	int master;
+	unsigned long nBytes;
+	unsigned long chunk;          // the size of each write()
+	useconds_t pause;             // the pause between writes
+	vector<long long> writeTimes; // when each chunk was written, if pausing
+};
+
+static void *writer(void *arg)
+{
+	Feed *f = static_cast<Feed *>(arg);
+	vector<unsigned char> buf(f->chunk);
+	for (unsigned long position = 0; position < f->nBytes; position += f->chunk) {
+		for (unsigned long i = 0; i < f->chunk; ++i) {
+			buf[i] = streamByte(position + i);
+		}
+		if (f->pause > 0) {
+			f->writeTimes.push_back(MonotonicTimer::now());
+		}
+		for (unsigned long done = 0; done < f->chunk; ) {
+			ssize_t r = write(f->master, &buf[done], f->chunk - done);
+			if (r <= 0) {
+				return 0;
+			}
+			done += r;
+		}
+		if (f->pause > 0) {
+			usleep(f->pause);
+		}
+	}
+	return 0;
+}
+
+// Open the master end of a fresh pseudo-terminal in raw mode.
+static int openMaster()
+{
+	int master = posix_openpt(O_RDWR | O_NOCTTY);
+	if (master < 0 || grantpt(master) < 0 || unlockpt(master) < 0) {
+		perror("AsyncInputTest: failed to open a pseudo-terminal");
+		exit(1);
+	}
+	struct termios t;
+	tcgetattr(master, &t);
+	cfmakeraw(&t);
+	tcsetattr(master, TCSANOW, &t);
+	return master;
+}
+
+static void testHandOff()
+{
+	int master = openMaster();
+	PosixSerial port(ptsname(master), 115200);
+	port.timeout(2000);
+	// Remarks: a ring much smaller than the stream keeps the reader waiting for room.
+	port.asyncInput(true, 256);
+
+	Feed f;
+	f.master = master;
+	f.nBytes = 1 << 20;
+	f.chunk = 4096;
+	f.pause = 0;
+	pthread_t thread;
+	CHECK(pthread_create(&thread, 0, writer, &f) == 0);
+
+	// Take the stream in pieces of every size, through every way of reading.
+	vector<unsigned char> buf(1000);
+	unsigned long position = 0;
+	unsigned long errors = 0;
+	for (unsigned long k = 0; position < f.nBytes; ++k) {
+		unsigned long n = min(k % buf.size() + 1, f.nBytes - position);
+		switch (k % 3) {
+			case 0:
+				port.getBlock(&buf[0], n);
+				break;
+			case 1:
+				n = port.readSome(&buf[0], n).nBytes;
+				break;
+			case 2:
+				buf[0] = port.getByte();
+				n = 1;
+				break;
+		}
+		for (unsigned long i = 0; i < n; ++i) {
+			errors += buf[i] != streamByte(position + i);
+		}
+		position += n;
+	}
+	CHECK(errors == 0);
+	pthread_join(thread, 0);
+	close(master);
+}
+
+static void testLines()
+{
+	int master = openMaster();
+	PosixSerial port(ptsname(master), 115200);
+	port.timeout(2000);
+	port.asyncInput(true, 64);
+	string sent;
+	for (int i = 0; i < 500; ++i) {
+		char line[32];
+		snprintf(line, sizeof(line), "line %d\n", i);
+		sent += line;
+	}
+	CHECK(write(master, sent.data(), sent.size()) == (ssize_t)sent.size());
+	string received;
+	for (int i = 0; i < 500; ++i) {
+		received += port.getLine();
+	}
+	CHECK(received == sent);
+	close(master);
+}
+
+static void testTimestamps()
+{
+	int master = openMaster();
+	PosixSerial port(ptsname(master), 115200);
+	port.timeout(2000);
+	port.asyncInput(true);
+	port.timestamps(true);
+
+	// Remarks: the reader takes (and stamps) input a byte at a time, more bytes than it can
+	// keep the stamps of until the input is read; whatever it couldn't keep must come out as
+	// unknown (0) rather than as the time of an earlier chunk.
+	Feed f;
+	f.master = master;
+	f.nBytes = 1500;
+	f.chunk = 1;
+	f.pause = 500;
+	pthread_t thread;
+	CHECK(pthread_create(&thread, 0, writer, &f) == 0);
+	pthread_join(thread, 0);
+	usleep(10000);
+
+	unsigned long known = 0;
+	unsigned long early = 0;
+	for (unsigned long i = 0; i < f.nBytes; ++i) {
+		unsigned char b;
+		long long arrival;
+		CHECK(port.readStamped(&b, 1, arrival).nBytes == 1 && b == streamByte(i));
+		if (arrival != 0) {
+			++known;
+			early += arrival < f.writeTimes[i];
+		}
+	}
+	CHECK(known > 0);
+	CHECK(early == 0);
+	close(master);
+}
+
+int main()
+{
+	testHandOff();
+	testLines();
+	testTimestamps();
+	return summary("AsyncInputTest");
+}
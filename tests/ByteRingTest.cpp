@@ -0,0 +1,194 @@
+/**
+ * \file    "ByteRingTest.cpp"
+ *
+ * \brief   Tests for ByteRing: its edges, wraparound, and its use across threads and processes.
+ */
+#include "Communication/ByteRing.h"
+#include "Check.h"
+using namespace metrobotics;
+
+#include <cstring>
+#include <vector>
+using namespace std;
+
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+// The byte at the given position of the test stream.
+static unsigned char streamByte(unsigned long position)
+{
+	return (unsigned char)(position * 7 + position / 251);
+}
+
+// Write the test stream into a ring, in chunks of varying size, spinning while it's full.
+static void produce(ByteRing& ring, unsigned long nBytes)
+{
+	unsigned char chunk[97];
+	unsigned long position = 0;
+	for (unsigned long k = 1; position < nBytes; k = k % sizeof(chunk) + 1) {
+		unsigned long n = min(k, nBytes - position);
+		for (unsigned long i = 0; i < n; ++i) {
+			chunk[i] = streamByte(position + i);
+		}
+		for (unsigned long done = 0; done < n; ) {
+			unsigned long w = ring.write(chunk + done, n - done);
+			if (w == 0) {
+				sched_yield();
+			}
+			done += w;
+		}
+		position += n;
+	}
+}
+
+// Read the test stream out of a ring, spinning while it's empty; returns the bytes that were
+// out of place.
+static unsigned long consume(ByteRing& ring, unsigned long nBytes)
+{
+	unsigned long errors = 0;
+	unsigned long position = 0;
+	while (position < nBytes) {
+		// Remarks: the ring is scanned in place, as the reader of asynchronous input does.
+		const unsigned char *src;
+		unsigned long n = min(ring.readSpace(&src), nBytes - position);
+		if (n == 0) {
+			sched_yield();
+			continue;
+		}
+		for (unsigned long i = 0; i < n; ++i) {
+			errors += src[i] != streamByte(position + i);
+		}
+		ring.commitRead(n);
+		position += n;
+	}
+	return errors;
+}
+
+static void *producer(void *arg)
+{
+	produce(*static_cast<ByteRing *>(arg), 1 << 22);
+	return 0;
+}
+
+static void testEdges()
+{
+	ByteRing ring(100);
+	CHECK(ring.capacity() == 128);
+
+	// Empty.
+	unsigned char buf[256];
+	const unsigned char *src;
+	CHECK(ring.readable() == 0);
+	CHECK(ring.writable() == 128);
+	CHECK(ring.read(buf, sizeof(buf)) == 0);
+	CHECK(ring.readSpace(&src) == 0);
+
+	// Full.
+	for (unsigned long i = 0; i < sizeof(buf); ++i) {
+		buf[i] = streamByte(i);
+	}
+	CHECK(ring.write(buf, sizeof(buf)) == 128);
+	CHECK(ring.readable() == 128);
+	CHECK(ring.writable() == 0);
+	CHECK(ring.write(buf, 1) == 0);
+	unsigned char *dst;
+	CHECK(ring.writeSpace(&dst) == 0);
+
+	// And empty again.
+	unsigned char out[256];
+	CHECK(ring.read(out, sizeof(out)) == 128);
+	CHECK(memcmp(out, buf, 128) == 0);
+	CHECK(ring.readable() == 0);
+	CHECK(ring.writable() == 128);
+}
+
+static void testWraparound()
+{
+	ByteRing ring(16);
+
+	// Leave the indices just short of the end of the storage.
+	unsigned char buf[16];
+	CHECK(ring.write(buf, 12) == 12);
+	CHECK(ring.read(buf, 12) == 12);
+
+	// The free space (and later the input) comes in two pieces: up to the end, and from the start.
+	unsigned char *dst;
+	CHECK(ring.writeSpace(&dst) == 4);
+	memcpy(dst, "abcd", 4);
+	ring.commitWrite(4);
+	CHECK(ring.writeSpace(&dst) == 12);
+	memcpy(dst, "efgh", 4);
+	ring.commitWrite(4);
+	const unsigned char *src;
+	CHECK(ring.readSpace(&src) == 4 && memcmp(src, "abcd", 4) == 0);
+	ring.commitRead(4);
+	CHECK(ring.readSpace(&src) == 4 && memcmp(src, "efgh", 4) == 0);
+	ring.commitRead(4);
+
+	// Copies straddle the end of the storage.
+	unsigned long position = 0;
+	unsigned long errors = 0;
+	for (unsigned long k = 1; k <= 1000; ++k) {
+		unsigned long n = k % 16 + 1;
+		for (unsigned long i = 0; i < n; ++i) {
+			buf[i] = streamByte(position + i);
+		}
+		CHECK(ring.write(buf, n) == n);
+		unsigned char out[16];
+		CHECK(ring.read(out, sizeof(out)) == n);
+		errors += memcmp(out, buf, n) != 0;
+		position += n;
+	}
+	CHECK(errors == 0);
+}
+
+static void testThreads()
+{
+	// Remarks: a small ring keeps both sides waiting for each other all the time.
+	ByteRing ring(64);
+	pthread_t thread;
+	CHECK(pthread_create(&thread, 0, producer, &ring) == 0);
+	CHECK(consume(ring, 1 << 22) == 0);
+	pthread_join(thread, 0);
+	CHECK(ring.readable() == 0);
+}
+
+static void testSharedMemory()
+{
+	// Remarks: the same memory is mapped twice, so that the consumer's view of the ring is at
+	// another address than the one it was placed at, as it would be in another process.
+	unsigned long size = ByteRing::footprint(256);
+	int fd = memfd_create("ByteRingTest", 0);
+	CHECK(fd >= 0 && ftruncate(fd, size) == 0);
+	void *a = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	void *b = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	CHECK(a != MAP_FAILED && b != MAP_FAILED && a != b);
+	ByteRing *placed = ByteRing::place(a, 256);
+	ByteRing *seen = static_cast<ByteRing *>(b);
+	CHECK(seen->capacity() == 256);
+
+	pid_t child = fork();
+	if (child == 0) {
+		produce(*placed, 1 << 20);
+		_exit(0);
+	}
+	CHECK(child > 0);
+	CHECK(consume(*seen, 1 << 20) == 0);
+	int status;
+	CHECK(waitpid(child, &status, 0) == child && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+	munmap(a, size);
+	munmap(b, size);
+}
+
+int main()
+{
+	testEdges();
+	testWraparound();
+	testThreads();
+	testSharedMemory();
+	return summary("ByteRingTest");
+}
@@ -0,0 +1,33 @@
+/**
+ * \file    "Check.h"
+ *
+ * \brief   The bare minimum that the test programs share.
+ *
+ * \details Each test program checks whatever it checks with CHECK(), which reports a failed
+ *          check (along with where it was made) and carries on, and returns summary() from
+ *          main(), so that "make test" stops at the first program that had a failure.
+ */
+#ifndef METROBOTICS_TESTS_CHECK_H
+#define METROBOTICS_TESTS_CHECK_H
+
+#include <cstdio>
+
+// The number of checks that have failed so far.
+static int gFailures = 0;
+
+#define CHECK(condition) \
+	do { \
+		if (!(condition)) { \
+			std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+			++gFailures; \
+		} \
+	} while (0)
+
+// Report how the program went; returns the exit status for main().
+static inline int summary(const char *name)
+{
+	std::printf("%-20s %s\n", name, gFailures == 0 ? "passed" : "FAILED");
+	return gFailures == 0 ? 0 : 1;
+}
+
+#endif
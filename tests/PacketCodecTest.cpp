@@ -0,0 +1,168 @@
+/**
+ * \file    "PacketCodecTest.cpp"
+ *
+ * \brief   Tests for PacketCodec: both ways of computing the checksum, the framing of packets
+ *          of awkward sizes, and the rejection of corrupted packets.
+ *
+ * \details The codec talks over a SharedLink; the test takes each packet off the other end as
+ *          it is on the wire, checks it, and echoes it back for the codec to receive.
+ */
+// Remarks: the source is included, rather than linked, to get at both checksum functions (the
+// one that checksum() doesn't pick on this CPU included) and at the COBS encoder.
+#include "Communication/PacketCodec.cpp"
+#include "Communication/SharedSerial.h"
+#include "Check.h"
+using namespace metrobotics;
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+using namespace std;
+
+static const unsigned int CHECK_VALUE = 0xE3069283u; // CRC-32C("123456789")
+
+static void testChecksum()
+{
+	const unsigned char *digits = (const unsigned char *)"123456789";
+	CHECK(PacketCodec::checksum(digits, 9) == CHECK_VALUE);
+	CHECK(~crcTable(digits, 9, ~0u) == CHECK_VALUE);
+	// Continuing a checksum gives the same result as computing it in one go.
+	CHECK(PacketCodec::checksum(digits + 4, 5, PacketCodec::checksum(digits, 4)) == CHECK_VALUE);
+	CHECK(PacketCodec::checksum(digits, 0) == 0);
+
+#ifdef __x86_64__
+	if (!__builtin_cpu_supports("sse4.2")) {
+		printf("PacketCodecTest: no SSE4.2 on this CPU, skipping its checksum\n");
+		return;
+	}
+	CHECK(~crcSse42(digits, 9, ~0u) == CHECK_VALUE);
+	// Remarks: every length and alignment around the 8-byte words that the instruction takes.
+	unsigned char buf[64 + 8];
+	for (unsigned long i = 0; i < sizeof(buf); ++i) {
+		buf[i] = (unsigned char)(i * 37 + 11);
+	}
+	unsigned long mismatches = 0;
+	for (unsigned long offset = 0; offset < 8; ++offset) {
+		for (unsigned long n = 0; n <= 64; ++n) {
+			mismatches += crcSse42(buf + offset, n, ~0u) != crcTable(buf + offset, n, ~0u);
+		}
+	}
+	CHECK(mismatches == 0);
+#endif
+}
+
+// Take the next packet off the wire, checking its framing, and echo it back.
+static bool echo(SharedSerial& wire, unsigned long payloadSize)
+{
+	vector<unsigned char> frame(encodedSize(payloadSize + CRC_SIZE) + 2);
+	unsigned long n = wire.getDelimited(&frame[0], frame.size(), 0);
+	if (n != 1 || frame[0] != 0) {
+		return false;
+	}
+	n += wire.getDelimited(&frame[1], frame.size() - 1, 0);
+	if (frame[n - 1] != 0 || memchr(&frame[1], 0, n - 2) != 0) {
+		return false;
+	}
+	wire.putBlock(&frame[0], n);
+	return true;
+}
+
+static void testRoundTrip()
+{
+	SharedLink link(8192);
+	SharedSerial port(link, SharedLink::FIRST_END);
+	SharedSerial wire(link, SharedLink::SECOND_END);
+	port.timeout(1000);
+	wire.timeout(1000);
+	PacketCodec codec(port, port);
+
+	// Remarks: COBS closes a block at every zero and after every 254 bytes without one, so the
+	// runs around 254 bytes (alone, and followed by a zero) are where it can go wrong.
+	vector<vector<unsigned char> > payloads;
+	payloads.push_back(vector<unsigned char>());
+	vector<unsigned char> noZeros(1000);
+	for (unsigned long i = 0; i < noZeros.size(); ++i) {
+		noZeros[i] = (unsigned char)(i % 255 + 1);
+	}
+	payloads.push_back(noZeros);
+	payloads.push_back(vector<unsigned char>(1, 0));
+	payloads.push_back(vector<unsigned char>(300, 0));
+	for (unsigned long run = 253; run <= 255; ++run) {
+		vector<unsigned char> p(run, 0xA5);
+		payloads.push_back(p);
+		p.push_back(0);
+		payloads.push_back(p);
+		p.insert(p.begin(), 0);
+		payloads.push_back(p);
+		payloads.push_back(vector<unsigned char>(2 * run, 0x5A));
+	}
+
+	for (unsigned long i = 0; i < payloads.size(); ++i) {
+		const vector<unsigned char>& p = payloads[i];
+		codec.send(p.empty() ? 0 : &p[0], p.size());
+		CHECK(echo(wire, p.size()));
+		PacketCodec::Packet packet = codec.receive();
+		CHECK(vector<unsigned char>(packet.data, packet.data + packet.size) == p);
+	}
+	CHECK(codec.dropped() == 0);
+}
+
+// Send a packet with the given checksum (rather than its own).
+static void sendRaw(SharedSerial& wire, const unsigned char *payload, unsigned long nBytes,
+                    unsigned int crc)
+{
+	vector<unsigned char> frame(encodedSize(nBytes + CRC_SIZE) + 2);
+	unsigned char trailer[CRC_SIZE];
+	for (unsigned long i = 0; i < CRC_SIZE; ++i) {
+		trailer[i] = (crc >> (8 * i)) & 0xFF;
+	}
+	frame[0] = 0;
+	CobsEncoder cobs(&frame[1]);
+	cobs.put(payload, nBytes);
+	cobs.put(trailer, CRC_SIZE);
+	unsigned long n = cobs.finish() + 1;
+	frame[n++] = 0;
+	wire.putBlock(&frame[0], n);
+}
+
+static void testCorruption()
+{
+	SharedLink link(8192);
+	SharedSerial port(link, SharedLink::FIRST_END);
+	SharedSerial wire(link, SharedLink::SECOND_END);
+	port.timeout(1000);
+	PacketCodec codec(port, port);
+
+	// A packet whose checksum is off by a bit is skipped; the intact one behind it isn't.
+	const unsigned char *bad = (const unsigned char *)"corrupted";
+	const unsigned char *good = (const unsigned char *)"intact";
+	sendRaw(wire, bad, 9, PacketCodec::checksum(bad, 9) ^ 0x100);
+	sendRaw(wire, good, 6, PacketCodec::checksum(good, 6));
+	PacketCodec::Packet packet = codec.receive();
+	CHECK(packet.size == 6 && memcmp(packet.data, good, 6) == 0);
+	CHECK(codec.dropped() == 1);
+
+	// So is a packet whose payload has been hit (here, by a zero that cuts it in two); the
+	// packet is taken back off the link before the codec sees it, and put back damaged.
+	unsigned char payload[32];
+	memset(payload, 'x', sizeof(payload));
+	vector<unsigned char> frame(encodedSize(sizeof(payload) + CRC_SIZE) + 2);
+	sendRaw(wire, payload, sizeof(payload), PacketCodec::checksum(payload, sizeof(payload)));
+	unsigned long n = port.available();
+	CHECK(n > 12);
+	port.getBlock(&frame[0], n);
+	frame[10] = 0;
+	wire.putBlock(&frame[0], n);
+	sendRaw(wire, good, 6, PacketCodec::checksum(good, 6));
+	packet = codec.receive();
+	CHECK(packet.size == 6 && memcmp(packet.data, good, 6) == 0);
+	CHECK(codec.dropped() == 3);
+}
+
+int main()
+{
+	testChecksum();
+	testRoundTrip();
+	testCorruption();
+	return summary("PacketCodecTest");
+}
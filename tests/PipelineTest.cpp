@@ -0,0 +1,136 @@
+/**
+ * \file    "PipelineTest.cpp"
+ *
+ * \brief   Tests for Pipeline: matching replies to requests, and stopping run().
+ *
+ * \details The pipeline talks over a SharedLink to a device that runs on another thread.
+ */
+#include "Communication/Pipeline.h"
+#include "Communication/SharedSerial.h"
+#include "Timer/MonotonicTimer.h"
+#include "Check.h"
+using namespace metrobotics;
+
+#include <atomic>
+#include <cstdlib>
+#include <future>
+#include <vector>
+using namespace std;
+
+#include <pthread.h>
+#include <unistd.h>
+
+// Requests and replies alike are two bytes long: the tag, and a value.
+class TwoBytes : public Pipeline::Protocol
+{
+	public:
+		unsigned long frame(const unsigned char *, unsigned long nBytes)
+		{
+			return nBytes >= 2 ? 2 : 0;
+		}
+
+		bool tag(const unsigned char *reply, unsigned long, unsigned long& tag)
+		{
+			tag = reply[0];
+			return true;
+		}
+};
+
+// The device: answers every request with its value doubled, in reverse order of every pair.
+static void *device(void *arg)
+{
+	SharedSerial port(*static_cast<SharedLink *>(arg), SharedLink::SECOND_END);
+	port.timeout(2000);
+	try {
+		for (;;) {
+			unsigned char first[2];
+			unsigned char second[2];
+			port.getBlock(first, 2);
+			port.getBlock(second, 2);
+			second[1] *= 2;
+			first[1] *= 2;
+			port.putBlock(second, 2);
+			port.putBlock(first, 2);
+		}
+	} catch (...) {
+	}
+	return 0;
+}
+
+static void testReplies()
+{
+	SharedLink link(256);
+	pthread_t thread;
+	CHECK(pthread_create(&thread, 0, device, &link) == 0);
+	{
+		SharedSerial port(link, SharedLink::FIRST_END);
+		port.timeout(2000);
+		TwoBytes protocol;
+		Pipeline pipeline(port, port, protocol, 4);
+		vector<future<Pipeline::Reply> > replies;
+		for (unsigned char tag = 0; tag < 100; ++tag) {
+			unsigned char request[2] = { tag, (unsigned char)(tag + 1) };
+			replies.push_back(pipeline.submit(tag, request, 2));
+		}
+		pipeline.drain();
+		unsigned long errors = 0;
+		for (unsigned long i = 0; i < replies.size(); ++i) {
+			Pipeline::Reply r = replies[i].get();
+			errors += r.tag != i || r.status != IO_OK || r.data.size() != 2 ||
+			          r.data[1] != (unsigned char)(2 * (i + 1));
+		}
+		CHECK(errors == 0);
+		CHECK(pipeline.unmatched() == 0);
+	}
+	pthread_join(thread, 0);
+}
+
+struct Runner
+{
+	Pipeline *pipeline;
+	atomic<bool> returned;
+};
+
+static void *runner(void *arg)
+{
+	Runner *r = static_cast<Runner *>(arg);
+	r->pipeline->run();
+	r->returned = true;
+	return 0;
+}
+
+static void testStop()
+{
+	// Remarks: the source waits forever for input that never comes.
+	SharedLink link(64);
+	SharedSerial port(link, SharedLink::FIRST_END);
+	SharedSerial other(link, SharedLink::SECOND_END);
+	TwoBytes protocol;
+	Pipeline pipeline(port, port, protocol);
+	Runner r;
+	r.pipeline = &pipeline;
+	r.returned = false;
+	pthread_t thread;
+	CHECK(pthread_create(&thread, 0, runner, &r) == 0);
+	usleep(100000);
+	CHECK(!r.returned);
+
+	pipeline.stop();
+	MonotonicTimer t;
+	while (!r.returned && t.elapsedNs() < 2000000000LL) {
+		usleep(1000);
+	}
+	CHECK(r.returned);
+	if (!r.returned) {
+		// There's no getting the thread back.
+		exit(summary("PipelineTest"));
+	}
+	pthread_join(thread, 0);
+}
+
+int main()
+{
+	testReplies();
+	testStop();
+	return summary("PipelineTest");
+}
@@ -0,0 +1,159 @@
+/**
+ * \file    "PosixSerialTest.cpp"
+ *
+ * \brief   Tests for PosixSerial's gathering writes, and its handling of a device that goes
+ *          away and comes back.
+ *
+ * \details The port is the slave end of a pseudo-terminal. A virtual hang-up (TIOCVHANGUP)
+ *          cuts off every descriptor that is open on it, as unplugging an adapter would, but
+ *          leaves the pseudo-terminal in place, so that it can be opened again.
+ */
+#include "Communication/PosixSerial.h"
+#include "Check.h"
+using namespace metrobotics;
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+using namespace std;
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+
+// Open the master end of a fresh pseudo-terminal in raw mode.
+static int openMaster()
+{
+	int master = posix_openpt(O_RDWR | O_NOCTTY);
+	if (master < 0 || grantpt(master) < 0 || unlockpt(master) < 0) {
+		perror("PosixSerialTest: failed to open a pseudo-terminal");
+		exit(1);
+	}
+	struct termios t;
+	tcgetattr(master, &t);
+	cfmakeraw(&t);
+	tcsetattr(master, TCSANOW, &t);
+	return master;
+}
+
+// Hang up the slave end of a pseudo-terminal.
+static bool hangUp(int master)
+{
+	int slave = open(ptsname(master), O_RDWR | O_NOCTTY);
+	if (slave < 0) {
+		return false;
+	}
+	bool done = ioctl(slave, TIOCVHANGUP) == 0;
+	close(slave);
+	return done;
+}
+
+// The byte at the given position of the test stream.
+static unsigned char streamByte(unsigned long position)
+{
+	return (unsigned char)(position * 7 + position / 251);
+}
+
+static void testBlocks()
+{
+	int master = openMaster();
+	PosixSerial port(ptsname(master), 115200);
+	port.timeout(500);
+	port.outputBuffer(64);
+
+	// Remarks: more blocks than go into one writev(), behind output that is being held back,
+	// and with empty blocks along the way.
+	vector<unsigned char> stream(2000);
+	for (unsigned long i = 0; i < stream.size(); ++i) {
+		stream[i] = streamByte(i);
+	}
+	port.putBlock(&stream[0], 10);
+	vector<DataBlock> blocks;
+	for (unsigned long position = 10, k = 0; position < stream.size(); ++k) {
+		DataBlock block;
+		block.buf = &stream[position];
+		block.nBytes = min(k % 7 == 3 ? 0 : k % 50 + 1, stream.size() - position);
+		blocks.push_back(block);
+		position += block.nBytes;
+	}
+	CHECK(blocks.size() > 16 * 3);
+	port.putBlocks(&blocks[0], blocks.size());
+
+	vector<unsigned char> received(stream.size());
+	unsigned long n = 0;
+	while (n < received.size()) {
+		ssize_t r = read(master, &received[n], received.size() - n);
+		if (r <= 0) {
+			break;
+		}
+		n += r;
+	}
+	CHECK(n == stream.size() && received == stream);
+	close(master);
+}
+
+static void testReconnect(bool async)
+{
+	int master = openMaster();
+	PosixSerial port(ptsname(master), 115200);
+	port.timeout(500);
+	if (async) {
+		port.asyncInput(true, 256);
+	}
+	CHECK(write(master, "a", 1) == 1);
+	CHECK(port.getByte() == 'a');
+	CHECK(hangUp(master));
+
+	// The read that runs into the hang-up fails...
+	bool thrown = false;
+	try {
+		port.getByte();
+	} catch (Serial::ReadFailure&) {
+		thrown = true;
+	}
+	CHECK(thrown);
+	CHECK(port.metrics().reconnects == 0);
+
+	// ...and the next I/O opens the device again, as it was configured before.
+	CHECK(port.available() == 0);
+	CHECK(port.metrics().reconnects == 1);
+	CHECK(port.descriptor() >= 0);
+	CHECK(write(master, "b", 1) == 1);
+	CHECK(port.getByte() == 'b');
+	port.putByte('c');
+	unsigned char c = 0;
+	CHECK(read(master, &c, 1) == 1 && c == 'c');
+	close(master);
+}
+
+static void testGone()
+{
+	int master = openMaster();
+	PosixSerial port(ptsname(master), 115200);
+	port.timeout(500);
+	close(master);
+
+	// A device that doesn't come back fails to reconnect, every time it's asked to.
+	unsigned char buf[8];
+	CHECK(port.readSome(buf, sizeof(buf)).status == IO_FAILURE);
+	for (int i = 0; i < 2; ++i) {
+		bool thrown = false;
+		try {
+			port.getByte();
+		} catch (Serial::ConnectionFailure&) {
+			thrown = true;
+		}
+		CHECK(thrown);
+	}
+	CHECK(port.metrics().reconnects == 0);
+}
+
+int main()
+{
+	testBlocks();
+	testReconnect(false);
+	testReconnect(true);
+	testGone();
+	return summary("PosixSerialTest");
+}
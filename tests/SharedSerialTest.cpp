@@ -0,0 +1,174 @@
+/**
+ * \file    "SharedSerialTest.cpp"
+ *
+ * \brief   Tests for SharedLink and SharedSerial, between threads and between processes.
+ */
+#include "Communication/SharedSerial.h"
+#include "Check.h"
+using namespace metrobotics;
+
+#include <cstring>
+#include <vector>
+using namespace std;
+
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+// The byte at the given position of the test stream.
+static unsigned char streamByte(unsigned long position)
+{
+	return (unsigned char)(position * 7 + position / 251);
+}
+
+// The size of the stream that each test sends.
+static const unsigned long STREAM_SIZE = 1 << 20;
+
+// Send the test stream, in blocks of varying size.
+static void send(Serial& port)
+{
+	unsigned char block[97];
+	unsigned long position = 0;
+	for (unsigned long k = 1; position < STREAM_SIZE; k = k % sizeof(block) + 1) {
+		unsigned long n = min(k, STREAM_SIZE - position);
+		for (unsigned long i = 0; i < n; ++i) {
+			block[i] = streamByte(position + i);
+		}
+		port.putBlock(block, n);
+		position += n;
+	}
+}
+
+// Receive the test stream; returns the bytes that were out of place.
+static unsigned long receive(Serial& port)
+{
+	unsigned char block[89];
+	unsigned long errors = 0;
+	unsigned long position = 0;
+	for (unsigned long k = 1; position < STREAM_SIZE; k = k % sizeof(block) + 1) {
+		unsigned long n = min(k, STREAM_SIZE - position);
+		port.getBlock(block, n);
+		for (unsigned long i = 0; i < n; ++i) {
+			errors += block[i] != streamByte(position + i);
+		}
+		position += n;
+	}
+	return errors;
+}
+
+static void *sender(void *arg)
+{
+	SharedSerial port(*static_cast<SharedLink *>(arg), SharedLink::FIRST_END);
+	send(port);
+	return 0;
+}
+
+static void testThreads()
+{
+	// Remarks: a small link keeps both ends waiting for each other all the time.
+	SharedLink link(256);
+	pthread_t thread;
+	CHECK(pthread_create(&thread, 0, sender, &link) == 0);
+	{
+		SharedSerial port(link, SharedLink::SECOND_END);
+		port.timeout(2000);
+		CHECK(receive(port) == 0);
+	}
+	pthread_join(thread, 0);
+}
+
+static void testTimeout()
+{
+	SharedLink link(64);
+	SharedSerial a(link, SharedLink::FIRST_END);
+	SharedSerial b(link, SharedLink::SECOND_END);
+	b.timeout(50);
+	unsigned char buf[128];
+	CHECK(b.readSome(buf, sizeof(buf), 0).status == IO_TIMEOUT);
+	CHECK(b.readSome(buf, sizeof(buf)).status == IO_TIMEOUT);
+	bool thrown = false;
+	try {
+		b.getByte();
+	} catch (Serial::ReadTimeout&) {
+		thrown = true;
+	}
+	CHECK(thrown);
+
+	// A full link times writes out just the same.
+	memset(buf, 'x', sizeof(buf));
+	IoResult r = b.writeSome(buf, sizeof(buf), 50);
+	CHECK(r.nBytes == link.capacity() && r.status == IO_OK);
+	CHECK(b.writeSome(buf, 1, 50).status == IO_TIMEOUT);
+	CHECK(a.available() == link.capacity());
+}
+
+static void testClose()
+{
+	SharedLink link(64);
+	SharedSerial b(link, SharedLink::SECOND_END);
+	b.timeout(1000);
+	{
+		SharedSerial a(link, SharedLink::FIRST_END);
+		a.putBlock((const unsigned char *)"abc", 3);
+	}
+
+	// What was sent before the other end went away can still be read; nothing more can.
+	unsigned char buf[8];
+	b.getBlock(buf, 3);
+	CHECK(memcmp(buf, "abc", 3) == 0);
+	CHECK(b.readSome(buf, sizeof(buf)).status == IO_FAILURE);
+	bool thrown = false;
+	try {
+		b.putByte('x');
+	} catch (Serial::WriteFailure&) {
+		thrown = true;
+	}
+	CHECK(thrown);
+
+	// The end may be opened again.
+	SharedSerial a(link, SharedLink::FIRST_END);
+	a.putByte('d');
+	CHECK(b.getByte() == 'd');
+}
+
+static void testProcesses()
+{
+	// Remarks: the child attaches to the link by name, as an unrelated process would; it checks
+	// the stream that it's sent, and sends it back.
+	const char *name = "/metrobotics-SharedSerialTest";
+	SharedLink::remove(name);
+	SharedLink link(name, 4096);
+	pid_t child = fork();
+	if (child == 0) {
+		int status = 1;
+		try {
+			SharedLink attached(name);
+			SharedSerial port(attached, SharedLink::SECOND_END);
+			port.timeout(5000);
+			if (receive(port) == 0) {
+				send(port);
+				status = 0;
+			}
+		} catch (...) {
+		}
+		_exit(status);
+	}
+	CHECK(child > 0);
+	{
+		SharedSerial port(link, SharedLink::FIRST_END);
+		port.timeout(5000);
+		send(port);
+		CHECK(receive(port) == 0);
+	}
+	int status;
+	CHECK(waitpid(child, &status, 0) == child && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+
+int main()
+{
+	testThreads();
+	testTimeout();
+	testClose();
+	testProcesses();
+	return summary("SharedSerialTest");
+}
@@ -0,0 +1,237 @@
+/**
+ * \file    "WireFormatTest.cpp"
+ *
+ * \brief   Tests for WireFormat: the byte order and width of entries on the wire, and arrays
+ *          that take more than one chunk.
+ *
+ * \details The streams go into (and come out of) memory, so that every block that the format
+ *          hands over can be looked at.
+ */
+#include "Communication/WireFormat.h"
+#include "Check.h"
+using namespace metrobotics;
+
+#include <cmath>
+#include <cstring>
+#include <vector>
+using namespace std;
+
+// A sink that keeps its output, and the size of each block that it was put in.
+class Capture : public DataSink
+{
+	public:
+		void putByte(const unsigned char b)
+		{
+			putBlock(&b, 1);
+		}
+
+		void putBlock(const unsigned char *buf, unsigned long nBytes)
+		{
+			data.insert(data.end(), buf, buf + nBytes);
+			blocks.push_back(nBytes);
+		}
+
+		vector<unsigned char> data;
+		vector<unsigned long> blocks;
+};
+
+// A source that hands out the given input, and keeps the size of each block that was asked for.
+class Playback : public DataSource
+{
+	public:
+		explicit Playback(const vector<unsigned char>& input)
+		:data(input),
+		 position(0)
+		{
+		}
+
+		unsigned char getByte()
+		{
+			unsigned char b;
+			getBlock(&b, 1);
+			return b;
+		}
+
+		void getBlock(unsigned char *buf, unsigned long nBytes)
+		{
+			if (nBytes > data.size() - position) {
+				throw Serial::ReadFailure();
+			}
+			memcpy(buf, &data[position], nBytes);
+			position += nBytes;
+			blocks.push_back(nBytes);
+		}
+
+		vector<unsigned char> data;
+		unsigned long position;
+		vector<unsigned long> blocks;
+};
+
+// Whether a buffer holds exactly the given bytes.
+static bool holds(const unsigned char *buf, unsigned long n, const unsigned char *expected,
+                  unsigned long nExpected)
+{
+	return n == nExpected && memcmp(buf, expected, n) == 0;
+}
+
+static void testByteOrder()
+{
+	WireFormat little(WireFormat::LITTLE_ENDIAN_ORDER);
+	WireFormat big(WireFormat::BIG_ENDIAN_ORDER);
+	unsigned char buf[32];
+
+	VectorN<unsigned int, 2> u;
+	u[0] = 0x01020304u;
+	u[1] = 0xA0B0C0D0u;
+	const unsigned char uLittle[] = { 0x04, 0x03, 0x02, 0x01, 0xD0, 0xC0, 0xB0, 0xA0 };
+	const unsigned char uBig[] = { 0x01, 0x02, 0x03, 0x04, 0xA0, 0xB0, 0xC0, 0xD0 };
+	CHECK(holds(buf, little.encode(u, buf), uLittle, sizeof(uLittle)));
+	CHECK(holds(buf, big.encode(u, buf), uBig, sizeof(uBig)));
+	VectorN<unsigned int, 2> uBack;
+	CHECK(little.decode(uLittle, uBack) == 8 && uBack == u);
+	CHECK(big.decode(uBig, uBack) == 8 && uBack == u);
+
+	// Signed entries keep their sign through the round trip.
+	VectorN<short, 2> s;
+	s[0] = -2;
+	s[1] = 0x1234;
+	const unsigned char sLittle[] = { 0xFE, 0xFF, 0x34, 0x12 };
+	const unsigned char sBig[] = { 0xFF, 0xFE, 0x12, 0x34 };
+	CHECK(holds(buf, little.encode(s, buf), sLittle, sizeof(sLittle)));
+	CHECK(holds(buf, big.encode(s, buf), sBig, sizeof(sBig)));
+	VectorN<short, 2> sBack;
+	CHECK(big.decode(sBig, sBack) == 4 && sBack == s);
+
+	VectorN<long long, 1> l;
+	l[0] = -0x0102030405060708LL;
+	const unsigned char lBig[] = { 0xFE, 0xFD, 0xFC, 0xFB, 0xFA, 0xF9, 0xF8, 0xF8 };
+	CHECK(holds(buf, big.encode(l, buf), lBig, sizeof(lBig)));
+	VectorN<long long, 1> lBack;
+	CHECK(big.decode(lBig, lBack) == 8 && lBack == l);
+
+	// Real entries are IEEE 754 numbers in the same order: 1.5 is 0x3FF8000000000000.
+	RealVectorN<1> d;
+	d[0] = 1.5;
+	const unsigned char dLittle[] = { 0, 0, 0, 0, 0, 0, 0xF8, 0x3F };
+	const unsigned char dBig[] = { 0x3F, 0xF8, 0, 0, 0, 0, 0, 0 };
+	CHECK(holds(buf, little.encode(d, buf), dLittle, sizeof(dLittle)));
+	CHECK(holds(buf, big.encode(d, buf), dBig, sizeof(dBig)));
+	RealVectorN<1> dBack;
+	CHECK(little.decode(dLittle, dBack) == 8 && dBack[0] == 1.5);
+}
+
+static void testFloat32()
+{
+	WireFormat little(WireFormat::LITTLE_ENDIAN_ORDER, WireFormat::FLOAT32);
+	WireFormat big(WireFormat::BIG_ENDIAN_ORDER, WireFormat::FLOAT32);
+	CHECK(little.entrySize<double>() == 4 && little.entrySize<int>() == sizeof(int));
+	unsigned char buf[32];
+
+	// -2.75 is 0xC0300000 as a float; 0.1 rounds to 0x3DCCCCCD.
+	RealVectorN<2> v;
+	v[0] = -2.75;
+	v[1] = 0.1;
+	CHECK(little.size(v) == 8);
+	const unsigned char vLittle[] = { 0x00, 0x00, 0x30, 0xC0, 0xCD, 0xCC, 0xCC, 0x3D };
+	const unsigned char vBig[] = { 0xC0, 0x30, 0x00, 0x00, 0x3D, 0xCC, 0xCC, 0xCD };
+	CHECK(holds(buf, little.encode(v, buf), vLittle, sizeof(vLittle)));
+	CHECK(holds(buf, big.encode(v, buf), vBig, sizeof(vBig)));
+
+	// What comes back is the nearest float: exact where the value is one, and within half a
+	// unit in the last place of it otherwise.
+	RealVectorN<2> back;
+	CHECK(big.decode(vBig, back) == 8);
+	CHECK(back[0] == -2.75);
+	CHECK(back[1] == (double)0.1f && back[1] != 0.1);
+	CHECK(fabs(back[1] - 0.1) <= 0.1 * ldexp(1.0, -24));
+
+	// Ties go to the even neighbour: 2^24 + 1 lies halfway between 2^24 and 2^24 + 2.
+	RealVectorN<2> ties;
+	ties[0] = 16777217.0;
+	ties[1] = 16777219.0;
+	little.encode(ties, buf);
+	little.decode(buf, back);
+	CHECK(back[0] == 16777216.0 && back[1] == 16777220.0);
+}
+
+// Write an array, check how it was put to the sink, and read it back.
+template <class T, size_t N, class V>
+static void checkArray(const WireFormat& format, unsigned long count)
+{
+	vector<V> v(count);
+	for (unsigned long k = 0; k < count; ++k) {
+		for (size_t i = 0; i < N; ++i) {
+			v[k][i] = (T)(k * N + i + 1);
+		}
+	}
+	Capture sink;
+	format.write(sink, &v[0], count);
+
+	// The bytes are those of the vectors one after the other, in blocks of no more than 512
+	// bytes, all of them full but the last.
+	unsigned long width = format.entrySize<T>();
+	unsigned long total = count * N * width;
+	vector<unsigned char> expected(total);
+	for (unsigned long k = 0; k < count; ++k) {
+		format.encode(v[k], &expected[k * N * width]);
+	}
+	CHECK(sink.data == expected);
+	CHECK(sink.blocks.size() == (total + 511) / 512);
+	for (unsigned long b = 0; b + 1 < sink.blocks.size(); ++b) {
+		CHECK(sink.blocks[b] == 512);
+	}
+
+	// Reading takes no more than the array, even when there's more input behind it.
+	vector<unsigned char> input(sink.data);
+	input.push_back(0xEE);
+	Playback source(input);
+	vector<V> back(count);
+	format.read(source, &back[0], count);
+	CHECK(source.position == total);
+	unsigned long errors = 0;
+	for (unsigned long k = 0; k < count; ++k) {
+		for (size_t i = 0; i < N; ++i) {
+			errors += back[k][i] != v[k][i];
+		}
+	}
+	CHECK(errors == 0);
+	CHECK(source.blocks.size() == sink.blocks.size());
+}
+
+static void testChunks()
+{
+	WireFormat format;
+	WireFormat compact(WireFormat::BIG_ENDIAN_ORDER, WireFormat::FLOAT32);
+
+	// Remarks: 32 of these vectors make a chunk; counts on either side of one and two chunks.
+	unsigned long counts[] = { 1, 31, 32, 33, 63, 64, 65, 100 };
+	for (unsigned long c = 0; c < sizeof(counts) / sizeof(counts[0]); ++c) {
+		checkArray<int, 4, VectorN<int, 4> >(format, counts[c]);
+	}
+
+	// Vectors that don't divide a chunk straddle its boundary: 512 bytes are 21 and a third
+	// RealVectorN<3>, or 42 and two thirds of them in the compact format.
+	unsigned long straddling[] = { 21, 22, 42, 43, 85, 86 };
+	for (unsigned long c = 0; c < sizeof(straddling) / sizeof(straddling[0]); ++c) {
+		checkArray<double, 3, RealVectorN<3> >(format, straddling[c]);
+		checkArray<double, 3, RealVectorN<3> >(compact, straddling[c]);
+	}
+
+	// A single vector goes out in one block.
+	VectorN<unsigned char, 3> bytes;
+	bytes[0] = 1;
+	bytes[1] = 2;
+	bytes[2] = 3;
+	Capture sink;
+	format.write(sink, bytes);
+	const unsigned char expected[] = { 1, 2, 3 };
+	CHECK(sink.blocks.size() == 1 && holds(&sink.data[0], sink.data.size(), expected, 3));
+}
+
+int main()
+{
+	testByteOrder();
+	testFloat32();
+	testChunks();
+	return summary("WireFormatTest");
+}